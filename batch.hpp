@@ -0,0 +1,264 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <condition_variable>
+
+namespace ns_batch
+{
+    // 微批处理：调用Submit的线程把任务交进来后阻塞，后台线程从第一个任务到达起
+    // 最多再等window_us微秒（或者攒够max_batch个），把这一批一起交给process处理，
+    // 处理完再唤醒这一批的所有调用者。process跑在唯一的后台线程上，所有调用者都在等它，
+    // 只适合做整批一起才能做的轻活（比如给查询分组排序），每个任务自己的重活要留给调用者在Submit返回后做
+    template <class Task>
+    class MicroBatcher
+    {
+    public:
+        typedef std::function<void(std::vector<Task *> &)> Processor;
+
+        MicroBatcher(Processor process, size_t window_us, size_t max_batch)
+            : _process(std::move(process)), _window(window_us), _max_batch(max_batch == 0 ? 1 : max_batch),
+              _stop(false), _batches(0), _tasks(0)
+        {
+            _thread = std::thread([this]
+                                  { Run(); });
+        }
+        ~MicroBatcher()
+        {
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                _stop = true;
+            }
+            _arrive.notify_all();
+            _thread.join();
+        }
+        MicroBatcher(const MicroBatcher &) = delete;
+        MicroBatcher &operator=(const MicroBatcher &) = delete;
+
+        // 阻塞直到task所在的那一批处理完
+        void Submit(Task *task)
+        {
+            Waiter w;
+            w.task = task;
+            w.done = false;
+            std::unique_lock<std::mutex> lock(_mtx);
+            _queue.push_back(&w);
+            if (_queue.size() == 1 || _queue.size() >= _max_batch)
+                _arrive.notify_one();
+            _finish.wait(lock, [&w]
+                         { return w.done; });
+        }
+
+        // 平均每批的任务数，用来观察批处理的效果
+        double AverageBatchSize() const
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            return _batches == 0 ? 0 : (double)_tasks / _batches;
+        }
+
+    private:
+        struct Waiter
+        {
+            Task *task;
+            bool done;
+        };
+
+        void Run()
+        {
+            std::vector<Waiter *> batch;
+            std::vector<Task *> tasks;
+            for (;;)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(_mtx);
+                    _arrive.wait(lock, [this]
+                                 { return _stop || !_queue.empty(); });
+                    if (_stop && _queue.empty())
+                        return;
+                    // 从第一个任务到达开始计时，窗口到了或者攒够了就开始处理
+                    auto deadline = std::chrono::steady_clock::now() + _window;
+                    _arrive.wait_until(lock, deadline, [this]
+                                       { return _stop || _queue.size() >= _max_batch; });
+                    batch.swap(_queue);
+                    ++_batches;
+                    _tasks += batch.size();
+                }
+                tasks.clear();
+                for (Waiter *w : batch)
+                    tasks.push_back(w->task);
+                _process(tasks);
+                {
+                    std::unique_lock<std::mutex> lock(_mtx);
+                    for (Waiter *w : batch)
+                        w->done = true;
+                }
+                _finish.notify_all();
+                batch.clear();
+            }
+        }
+
+    private:
+        Processor _process;
+        std::chrono::microseconds _window;
+        size_t _max_batch;
+        bool _stop;
+        size_t _batches; // 处理过的批数
+        size_t _tasks;   // 处理过的任务数
+        std::vector<Waiter *> _queue;
+        std::thread _thread;
+        mutable std::mutex _mtx;
+        std::condition_variable _arrive; // 有任务到达
+        std::condition_variable _finish; // 有一批处理完
+    };
+
+    // 常驻的一组工作线程，反复执行For：线程只在构造时创建一次，各线程的thread_local临时空间
+    // （比如分词上下文）在多次调用之间一直复用。
+    // For把[0, n)交给所有线程执行fn(worker, i)，worker是[0, Threads())里的线程编号，调用线程是0号。
+    // 每个线程先分到连续的一段，从前往后做；做完自己的就去别的线程那里偷走剩下的后一半，
+    // 文档长短差得很多时也不会有线程早早闲着。全部做完才返回，同时只能有一个For在跑
+    class ParallelRunner
+    {
+    public:
+        // threads为0时取CPU核数；只有一个线程时不创建线程，直接在调用线程上跑
+        explicit ParallelRunner(size_t threads)
+            : _threads(threads == 0 ? std::max<size_t>(1, std::thread::hardware_concurrency()) : threads),
+              _ranges(new Range[_threads]), _generation(0), _active(0), _stop(false)
+        {
+            for (size_t w = 1; w < _threads; w++)
+                _workers.emplace_back([this, w]
+                                      { Loop(w); });
+        }
+        ~ParallelRunner()
+        {
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                _stop = true;
+            }
+            _start.notify_all();
+            for (auto &t : _workers)
+                t.join();
+        }
+        ParallelRunner(const ParallelRunner &) = delete;
+        ParallelRunner &operator=(const ParallelRunner &) = delete;
+
+        size_t Threads() const { return _threads; }
+
+        template <class Fn>
+        void For(size_t n, Fn fn)
+        {
+            std::lock_guard<std::mutex> run(_run_mtx);
+            if (_threads == 1)
+            {
+                for (size_t i = 0; i < n; i++)
+                    fn(0, i);
+                return;
+            }
+            for (size_t w = 0; w < _threads; w++)
+            {
+                _ranges[w].begin = n * w / _threads;
+                _ranges[w].end = n * (w + 1) / _threads;
+            }
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                _fn = fn;
+                _active = _threads - 1;
+                ++_generation;
+            }
+            _start.notify_all();
+            Work(0);
+            std::unique_lock<std::mutex> lock(_mtx);
+            _done.wait(lock, [this]
+                       { return _active == 0; });
+            _fn = nullptr;
+        }
+
+    private:
+        struct Range
+        {
+            std::mutex mtx;
+            size_t begin = 0;
+            size_t end = 0;
+        };
+
+        // 工作线程：等下一次For，做完报告
+        void Loop(size_t self)
+        {
+            uint64_t seen = 0;
+            for (;;)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(_mtx);
+                    _start.wait(lock, [this, seen]
+                                { return _stop || _generation != seen; });
+                    if (_stop)
+                        return;
+                    seen = _generation;
+                }
+                Work(self);
+                std::unique_lock<std::mutex> lock(_mtx);
+                if (--_active == 0)
+                    _done.notify_one();
+            }
+        }
+
+        void Work(size_t self)
+        {
+            size_t i;
+            do
+            {
+                while (Pop(self, &i))
+                    _fn(self, i);
+            } while (Steal(self));
+        }
+
+        bool Pop(size_t self, size_t *i)
+        {
+            std::unique_lock<std::mutex> lock(_ranges[self].mtx);
+            if (_ranges[self].begin == _ranges[self].end)
+                return false;
+            *i = _ranges[self].begin++;
+            return true;
+        }
+
+        // 自己的做完了，从下一个线程开始找一个还有剩的，偷走后一半（只剩一个就偷那一个）
+        bool Steal(size_t self)
+        {
+            for (size_t k = 1; k < _threads; k++)
+            {
+                Range &victim = _ranges[(self + k) % _threads];
+                size_t begin, end;
+                {
+                    std::unique_lock<std::mutex> lock(victim.mtx);
+                    if (victim.begin == victim.end)
+                        continue;
+                    begin = victim.begin + (victim.end - victim.begin) / 2;
+                    end = victim.end;
+                    victim.end = begin;
+                }
+                std::unique_lock<std::mutex> lock(_ranges[self].mtx);
+                _ranges[self].begin = begin;
+                _ranges[self].end = end;
+                return true;
+            }
+            return false;
+        }
+
+    private:
+        const size_t _threads;
+        std::unique_ptr<Range[]> _ranges;
+        std::function<void(size_t, size_t)> _fn; // 这一次For要做的事
+        std::vector<std::thread> _workers;
+        std::mutex _run_mtx; // For同时只有一个
+        std::mutex _mtx;
+        std::condition_variable _start; // 有新的For
+        std::condition_variable _done;  // 工作线程都做完了
+        uint64_t _generation;           // 第几次For，工作线程靠它判断有没有新任务
+        size_t _active;                 // 这一次For还没做完的工作线程数
+        bool _stop;
+    };
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <zlib.h>
+#include <brotli/encode.h>
+#include "util.hpp"
+
+namespace ns_compress
+{
+    enum Encoding
+    {
+        ENCODING_NONE = 0,
+        ENCODING_GZIP,
+        ENCODING_BR
+    };
+
+    const size_t MIN_COMPRESS_SIZE = 1024; // 小于这个字节数的响应压缩不划算，直接发原文
+    const int GZIP_LEVEL = 6;              // 动态内容用的gzip级别
+    const int BROTLI_QUALITY = 5;          // 动态内容用的brotli质量，兼顾速度和压缩率
+
+    inline const char *EncodingName(Encoding e)
+    {
+        switch (e)
+        {
+        case ENCODING_GZIP:
+            return "gzip";
+        case ENCODING_BR:
+            return "br";
+        default:
+            return "identity";
+        }
+    }
+
+    // 根据请求头Accept-Encoding选编码：br优先，其次gzip，q=0的表示明确不接受
+    inline Encoding Negotiate(const std::string &accept_encoding)
+    {
+        bool gzip = false, br = false, star = false;
+        size_t pos = 0;
+        while (pos < accept_encoding.size())
+        {
+            size_t comma = accept_encoding.find(',', pos);
+            if (comma == std::string::npos)
+                comma = accept_encoding.size();
+            std::string item = accept_encoding.substr(pos, comma - pos);
+            pos = comma + 1;
+
+            std::string name = item;
+            bool accepted = true;
+            size_t semi = item.find(';');
+            if (semi != std::string::npos)
+            {
+                name = item.substr(0, semi);
+                size_t q = item.find("q=", semi);
+                if (q != std::string::npos && std::strtod(item.c_str() + q + 2, nullptr) <= 0)
+                    accepted = false;
+            }
+            boost::trim(name);
+            ns_util::StringUtil::ToLowerAscii(&name);
+            if (name == "br")
+                br = accepted;
+            else if (name == "gzip")
+                gzip = accepted;
+            else if (name == "*")
+                star = accepted;
+        }
+        if (br || (star && accept_encoding.find("br") == std::string::npos))
+            return ENCODING_BR;
+        if (gzip || (star && accept_encoding.find("gzip") == std::string::npos))
+            return ENCODING_GZIP;
+        return ENCODING_NONE;
+    }
+
+    // gzip格式（带gzip头和crc），结果写到out
+    inline bool Gzip(const char *data, size_t len, std::string *out, int level = GZIP_LEVEL)
+    {
+        z_stream zs;
+        std::memset(&zs, 0, sizeof(zs));
+        if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            LOG(ERROR) << "deflateInit2 error";
+            return false;
+        }
+        out->resize(deflateBound(&zs, len));
+        zs.next_in = (Bytef *)data;
+        zs.avail_in = (uInt)len;
+        zs.next_out = (Bytef *)&(*out)[0];
+        zs.avail_out = (uInt)out->size();
+        int ret = deflate(&zs, Z_FINISH);
+        out->resize(zs.total_out);
+        deflateEnd(&zs);
+        if (ret != Z_STREAM_END)
+        {
+            LOG(ERROR) << "deflate error " << ret;
+            return false;
+        }
+        return true;
+    }
+
+    inline bool Brotli(const char *data, size_t len, std::string *out, int quality = BROTLI_QUALITY)
+    {
+        size_t out_len = BrotliEncoderMaxCompressedSize(len);
+        if (out_len == 0)
+            out_len = len + 1024;
+        out->resize(out_len);
+        if (!BrotliEncoderCompress(quality, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, len, (const uint8_t *)data,
+                                   &out_len, (uint8_t *)&(*out)[0]))
+        {
+            LOG(ERROR) << "brotli compress error";
+            return false;
+        }
+        out->resize(out_len);
+        return true;
+    }
+
+    inline bool Compress(Encoding e, const char *data, size_t len, std::string *out)
+    {
+        if (e == ENCODING_GZIP)
+            return Gzip(data, len, out);
+        if (e == ENCODING_BR)
+            return Brotli(data, len, out);
+        return false;
+    }
+}
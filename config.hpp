@@ -0,0 +1,230 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdlib>
+#include <cerrno>
+#include <thread>
+#include <boost/algorithm/string.hpp>
+#include "log.hpp"
+
+namespace ns_config
+{
+    const char *const DEFAULT_CONFIG_PATH = "./httpserver.conf";
+
+    // httpserver的运行参数，先取默认值，再用配置文件覆盖，最后用命令行覆盖
+    struct ServerConfig
+    {
+        std::string frontend = "epoll";  // epoll或者httplib
+        std::string address = "0.0.0.0"; // 监听地址
+        int port = 8081;                 // 监听端口
+        int backlog = 1024;              // listen的全连接队列长度
+        size_t loops = 0;                // epoll前端的事件循环个数，0表示取CPU核数
+        size_t threads = 0;              // 工作线程数，0表示取CPU核数
+        size_t max_queued = 1024;        // 等待工作线程的连接数上限，超过直接回503，0表示不限
+        size_t batch_window_us = 0;       // 查询微批处理的等待窗口（微秒），0表示不开启
+        size_t batch_max = 64;            // 一批最多的查询数
+        size_t keep_alive_max_count = 100; // 一个长连接上最多处理的请求数
+        time_t keep_alive_timeout = 5;     // 长连接空闲多少秒后关闭
+        time_t read_timeout = 5;           // 读请求的超时（秒）
+        time_t write_timeout = 5;          // 写响应的超时（秒）
+        size_t payload_max_length = 64 * 1024; // 请求体的最大字节数
+        std::string input = "data/raw_html/raw.txt"; // 去标签后的文档
+        std::string root = "./wwwroot";              // 静态文件目录
+        size_t static_max_age = 3600;                // 非html静态文件的Cache-Control max-age（秒）
+        size_t static_memory_limit = 1024 * 1024;    // 超过这个字节数的静态文件不进内存，用sendfile发
+        size_t static_watch = 1;                     // 1表示监视静态文件目录，有变化自动重新加载
+        ns_log::Level log_level = ns_log::INFO;      // 低于这个级别的日志不输出
+        std::string log_file;                        // 日志文件，空表示写到标准错误
+        std::string admin_token;                     // 管理接口/admin/*的X-Admin-Token请求头，空表示不开管理接口
+
+        size_t WorkerThreads() const
+        {
+            if (threads > 0)
+                return threads;
+            size_t n = std::thread::hardware_concurrency();
+            return n > 0 ? n : 8;
+        }
+
+        // 设置一项，key不认识或者value不合法返回false，原因写进error
+        bool Set(const std::string &key, const std::string &value, std::string *error)
+        {
+            if (key == "frontend")
+            {
+                if (value != "epoll" && value != "httplib")
+                {
+                    *error = "must be epoll or httplib";
+                    return false;
+                }
+                frontend = value;
+            }
+            else if (key == "address")
+                address = value;
+            else if (key == "input")
+                input = value;
+            else if (key == "root")
+                root = value;
+            else if (key == "log_level")
+            {
+                if (!ns_log::ParseLevel(value, &log_level))
+                {
+                    *error = "must be debug, info, warning or error";
+                    return false;
+                }
+            }
+            else if (key == "log_file")
+                log_file = value;
+            else if (key == "admin_token")
+                admin_token = value;
+            // 数值都有取值范围，超出范围的直接报错，不截断
+            else if (key == "static_max_age")
+                return ToNumber(value, 0, 365 * 24 * 3600, &static_max_age, error);
+            else if (key == "static_memory_limit")
+                return ToNumber(value, 0, 1LL << 30, &static_memory_limit, error);
+            else if (key == "static_watch")
+                return ToNumber(value, 0, 1, &static_watch, error);
+            else if (key == "port")
+                return ToNumber(value, 1, 65535, &port, error);
+            else if (key == "backlog")
+                return ToNumber(value, 1, 65535, &backlog, error);
+            else if (key == "loops")
+                return ToNumber(value, 0, MAX_THREADS, &loops, error); // 0表示取CPU核数，不会真的是0个
+            else if (key == "threads")
+                return ToNumber(value, 0, MAX_THREADS, &threads, error);
+            else if (key == "max_queued")
+                return ToNumber(value, 0, 1 << 20, &max_queued, error);
+            else if (key == "batch_window_us")
+                return ToNumber(value, 0, 1000 * 1000, &batch_window_us, error);
+            else if (key == "batch_max")
+                return ToNumber(value, 1, 4096, &batch_max, error);
+            else if (key == "keep_alive_max_count")
+                return ToNumber(value, 1, 1 << 20, &keep_alive_max_count, error);
+            else if (key == "keep_alive_timeout")
+                return ToNumber(value, 1, 3600, &keep_alive_timeout, error);
+            else if (key == "read_timeout")
+                return ToNumber(value, 1, 3600, &read_timeout, error);
+            else if (key == "write_timeout")
+                return ToNumber(value, 1, 3600, &write_timeout, error);
+            else if (key == "payload_max_length")
+                return ToNumber(value, 0, 1LL << 30, &payload_max_length, error);
+            else
+            {
+                *error = "unknown option";
+                return false;
+            }
+            return true;
+        }
+
+        // 配置文件：每行 key = value，#开头的是注释
+        bool LoadFile(const std::string &path)
+        {
+            std::ifstream in(path);
+            if (!in.is_open())
+            {
+                std::cerr << "open config " << path << " error" << std::endl;
+                return false;
+            }
+            std::string line;
+            int lineno = 0;
+            while (std::getline(in, line))
+            {
+                ++lineno;
+                size_t sharp = line.find('#');
+                if (sharp != std::string::npos)
+                    line.erase(sharp);
+                boost::trim(line);
+                if (line.empty())
+                    continue;
+                size_t eq = line.find('=');
+                if (eq == std::string::npos)
+                {
+                    std::cerr << path << ":" << lineno << " missing '='" << std::endl;
+                    return false;
+                }
+                std::string key = line.substr(0, eq);
+                std::string value = line.substr(eq + 1);
+                boost::trim(key);
+                boost::trim(value);
+                std::string error;
+                if (!Set(key, value, &error))
+                {
+                    std::cerr << path << ":" << lineno << " bad option " << key << " = " << value << ": " << error << std::endl;
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // 命令行：--config=文件 先加载（没给就试着加载DEFAULT_CONFIG_PATH），其余 --key=value 覆盖配置文件里的值
+        bool ParseArgs(int argc, char *argv[])
+        {
+            bool has_config = false;
+            for (int i = 1; i < argc; i++)
+            {
+                std::string arg = argv[i];
+                if (arg.compare(0, 9, "--config=") != 0)
+                    continue;
+                has_config = true;
+                if (!LoadFile(arg.substr(9)))
+                    return false;
+            }
+            if (!has_config && std::ifstream(DEFAULT_CONFIG_PATH).good() && !LoadFile(DEFAULT_CONFIG_PATH))
+                return false;
+            for (int i = 1; i < argc; i++)
+            {
+                std::string arg = argv[i];
+                if (arg == "-h" || arg == "--help")
+                {
+                    Usage(argv[0]);
+                    return false;
+                }
+                size_t eq = arg.find('=');
+                if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos)
+                {
+                    std::cerr << "bad argument " << arg << std::endl;
+                    Usage(argv[0]);
+                    return false;
+                }
+                std::string key = arg.substr(2, eq - 2);
+                if (key == "config")
+                    continue;
+                std::string error;
+                if (!Set(key, arg.substr(eq + 1), &error))
+                {
+                    std::cerr << "bad option " << arg << ": " << error << std::endl;
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        static void Usage(const char *prog)
+        {
+            std::cerr << "usage: " << prog << " [--config=file] [--key=value ...]\n"
+                      << "keys: frontend address port backlog loops threads max_queued batch_window_us batch_max\n"
+                      << "      keep_alive_max_count keep_alive_timeout"
+                      << " read_timeout write_timeout payload_max_length input root\n"
+                      << "      static_max_age static_memory_limit static_watch log_level log_file admin_token" << std::endl;
+        }
+
+    private:
+        static const long long MAX_THREADS = 1024; // loops和threads的上限
+
+        // 十进制整数，必须在[lo, hi]里，不合法时返回false并写好原因
+        template <class T>
+        static bool ToNumber(const std::string &value, long long lo, long long hi, T *out, std::string *error)
+        {
+            char *end = nullptr;
+            errno = 0;
+            long long n = std::strtoll(value.c_str(), &end, 10);
+            if (value.empty() || *end != '\0' || errno == ERANGE || n < lo || n > hi)
+            {
+                *error = "must be an integer in [" + std::to_string(lo) + ", " + std::to_string(hi) + "]";
+                return false;
+            }
+            *out = (T)n;
+            return true;
+        }
+    };
+}
@@ -0,0 +1,17 @@
+#include "util.hpp"
+
+// 离线把文本词典、用户词典和HMM模型编译成一个词典镜像（带校验和），
+// searcher/httpserver启动时直接mmap，不用再解析文本、排序、建trie。
+// 词典文件改过以后要重新运行，否则启动时会发现镜像过期，退回去解析文本词典
+// 用法：./dict_compiler [输出路径]，默认写到 ./dict/jieba.dict.img
+int main(int argc, char *argv[])
+{
+    std::string out = argc > 1 ? argv[1] : ns_util::DICT_IMAGE_PATH;
+    if (!cppjieba::Jieba::CompileImage(ns_util::DICT_PATH, ns_util::HMM_PATH, ns_util::USER_DICT_PATH, out))
+    {
+        LOG(ERROR) << "compile " << out << " error";
+        return 1;
+    }
+    LOG(INFO) << "词典镜像已写入 " << out;
+    return 0;
+}
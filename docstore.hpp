@@ -0,0 +1,521 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <list>
+#include <memory>
+#include <cstring>
+#include <cstdint>
+#include <unordered_map>
+#include <mutex>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "util.hpp"
+
+namespace ns_docstore
+{
+    // 内置的LZ77块压缩编码（格式参照LZ4）：
+    // [token][扩展字面量长度][字面量][2字节偏移][扩展匹配长度] ...
+    // token高4位是字面量长度，低4位是匹配长度-4，取值15时后面跟255累加的扩展长度
+    class LzCodec
+    {
+    private:
+        static const int MIN_MATCH = 4;
+        static const int HASH_BITS = 14;
+        static const size_t MAX_OFFSET = 65535;
+
+        static uint32_t Read32(const unsigned char *p)
+        {
+            uint32_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+        static uint32_t Hash(uint32_t v)
+        {
+            return (v * 2654435761u) >> (32 - HASH_BITS);
+        }
+        static void PutLength(std::string *out, size_t len)
+        {
+            while (len >= 255)
+            {
+                out->push_back((char)255);
+                len -= 255;
+            }
+            out->push_back((char)len);
+        }
+        static void PutSequence(std::string *out, const unsigned char *lit, size_t lit_len, size_t offset, size_t match_len)
+        {
+            size_t ml = match_len >= MIN_MATCH ? match_len - MIN_MATCH : 0;
+            unsigned char token = (unsigned char)(((lit_len < 15 ? lit_len : 15) << 4) | (ml < 15 ? ml : 15));
+            out->push_back((char)token);
+            if (lit_len >= 15)
+                PutLength(out, lit_len - 15);
+            out->append((const char *)lit, lit_len);
+            if (match_len == 0) // 最后一段只有字面量
+                return;
+            out->push_back((char)(offset & 0xff));
+            out->push_back((char)(offset >> 8));
+            if (ml >= 15)
+                PutLength(out, ml - 15);
+        }
+
+    public:
+        static void Compress(const char *data, size_t len, std::string *out)
+        {
+            out->clear();
+            out->reserve(len / 2 + 16);
+            const unsigned char *src = (const unsigned char *)data;
+            std::vector<uint32_t> table(1u << HASH_BITS, 0); // 存位置+1，0表示空
+            size_t anchor = 0;
+            size_t i = 0;
+            // 末尾留出空间，保证Read32不越界
+            while (len >= MIN_MATCH && i + MIN_MATCH <= len)
+            {
+                uint32_t seq = Read32(src + i);
+                uint32_t h = Hash(seq);
+                size_t cand = table[h];
+                table[h] = (uint32_t)(i + 1);
+                if (cand == 0 || i - (cand - 1) > MAX_OFFSET || Read32(src + cand - 1) != seq)
+                {
+                    ++i;
+                    continue;
+                }
+                size_t ref = cand - 1;
+                size_t match_len = MIN_MATCH;
+                while (i + match_len < len && src[ref + match_len] == src[i + match_len])
+                    ++match_len;
+                PutSequence(out, src + anchor, i - anchor, i - ref, match_len);
+                i += match_len;
+                anchor = i;
+            }
+            PutSequence(out, src + anchor, len - anchor, 0, 0);
+        }
+
+        static bool Decompress(const char *data, size_t len, size_t raw_len, std::string *out)
+        {
+            out->clear();
+            out->reserve(raw_len);
+            const unsigned char *p = (const unsigned char *)data;
+            const unsigned char *end = p + len;
+            while (p < end)
+            {
+                unsigned char token = *p++;
+                size_t lit_len = token >> 4;
+                if (lit_len == 15)
+                {
+                    unsigned char b;
+                    do
+                    {
+                        if (p >= end)
+                            return false;
+                        b = *p++;
+                        lit_len += b;
+                    } while (b == 255);
+                }
+                if ((size_t)(end - p) < lit_len)
+                    return false;
+                out->append((const char *)p, lit_len);
+                p += lit_len;
+                if (p == end) // 最后一段
+                    break;
+                if (end - p < 2)
+                    return false;
+                size_t offset = p[0] | (p[1] << 8);
+                p += 2;
+                size_t match_len = token & 0x0f;
+                if (match_len == 15)
+                {
+                    unsigned char b;
+                    do
+                    {
+                        if (p >= end)
+                            return false;
+                        b = *p++;
+                        match_len += b;
+                    } while (b == 255);
+                }
+                match_len += MIN_MATCH;
+                if (offset == 0 || offset > out->size())
+                    return false;
+                // 匹配区可能与输出重叠，只能逐字节复制
+                size_t from = out->size() - offset;
+                for (size_t k = 0; k < match_len; k++)
+                    out->push_back((*out)[from + k]);
+            }
+            return out->size() == raw_len;
+        }
+    };
+
+    // 文档视图：三个字段都指向块内存（mmap文件或解压缓存），hold负责让解压块在使用期间不被淘汰
+    struct DocView
+    {
+        ns_util::StringView title;
+        ns_util::StringView content;
+        ns_util::StringView url;
+        uint64_t doc_id;
+        std::shared_ptr<const std::string> hold;
+        DocView() : doc_id(0) {}
+    };
+
+    enum Codec
+    {
+        CODEC_NONE = 0, // 不压缩，视图直接指向mmap的文件页
+        CODEC_LZ = 1    // LzCodec块压缩
+    };
+
+    // 文档仓库：按顺序把文档(title, content, url)拼到约64KB的块里，按codec压缩后存放。
+    // 建好后可以落盘成一个文件，之后通过mmap打开，块表和文档表都是定长记录，直接在映射上访问，
+    // 只有真正被展示的文档所在的页才会被缺页加载。压缩块读取时整块解压并放入一个小的LRU缓存
+    class DocStore
+    {
+    private:
+        struct BlockMeta
+        {
+            uint64_t offset;   // 在数据区中的偏移
+            uint32_t comp_len; // 存储长度
+            uint32_t raw_len;  // 原始长度
+        };
+        struct DocMeta
+        {
+            uint32_t block;     // 所在块
+            uint32_t offset;    // 块内偏移
+            uint32_t title_len; // 三段连续存放: title content url
+            uint32_t content_len;
+            uint32_t url_len;
+        };
+        // 文件格式: [FileHeader][BlockMeta * block_count][DocMeta * doc_count][数据区]
+        struct FileHeader
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t codec;
+            uint64_t doc_count;
+            uint64_t block_count;
+            uint64_t data_offset;
+            uint64_t data_len;
+            uint64_t source_size;     // 生成时raw.txt的大小
+            uint64_t source_checksum; // 生成时raw.txt内容的校验和，大小相同内容变了也能发现
+        };
+        typedef std::shared_ptr<const std::string> BlockPtr;
+
+    public:
+        explicit DocStore(Codec codec = CODEC_LZ, size_t block_size = 64 * 1024, size_t cache_blocks = 16)
+            : _codec(codec), _block_size(block_size), _cache_blocks(cache_blocks)
+        {
+        }
+        ~DocStore() { Unmap(); }
+        DocStore(const DocStore &) = delete;
+        DocStore &operator=(const DocStore &) = delete;
+
+        // 追加一篇文档，返回它的序号
+        uint64_t Add(const std::string &title, const std::string &content, const std::string &url)
+        {
+            DocMeta meta;
+            meta.block = (uint32_t)_blocks.size();
+            meta.offset = (uint32_t)_pending.size();
+            meta.title_len = (uint32_t)title.size();
+            meta.content_len = (uint32_t)content.size();
+            meta.url_len = (uint32_t)url.size();
+            _pending += title;
+            _pending += content;
+            _pending += url;
+            _docs.push_back(meta);
+            if (_pending.size() >= _block_size)
+                FlushBlock();
+            return _docs.size() - 1;
+        }
+
+        // 建索引结束后调用，压缩最后一个未满的块
+        void Finish()
+        {
+            if (!_pending.empty())
+                FlushBlock();
+            std::string().swap(_pending);
+            _blob.shrink_to_fit();
+            _block_tab = _blocks.data();
+            _block_cnt = _blocks.size();
+            _doc_tab = _docs.data();
+            _doc_cnt = _docs.size();
+            _data = _blob.data();
+        }
+
+        // 把Finish之后的仓库写成文件
+        bool Save(const std::string &path, uint64_t source_size, uint64_t source_checksum) const
+        {
+            std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+            if (!out.is_open())
+            {
+                LOG(ERROR) << "open " << path << " error!";
+                return false;
+            }
+            FileHeader header;
+            std::memset(&header, 0, sizeof(header));
+            std::memcpy(header.magic, Magic(), sizeof(header.magic));
+            header.version = VERSION;
+            header.codec = _codec;
+            header.doc_count = _docs.size();
+            header.block_count = _blocks.size();
+            header.data_offset = sizeof(FileHeader) + _blocks.size() * sizeof(BlockMeta) + _docs.size() * sizeof(DocMeta);
+            header.data_len = _blob.size();
+            header.source_size = source_size;
+            header.source_checksum = source_checksum;
+            out.write((const char *)&header, sizeof(header));
+            out.write((const char *)_blocks.data(), _blocks.size() * sizeof(BlockMeta));
+            out.write((const char *)_docs.data(), _docs.size() * sizeof(DocMeta));
+            out.write(_blob.data(), _blob.size());
+            return out.good();
+        }
+
+        // mmap打开Save写出的文件，raw.txt的大小和校验和都对得上才用。
+        // 文件可能被截断或者损坏，块表和文档表里的每一项都检查不越界
+        bool Open(const std::string &path, uint64_t source_size, uint64_t source_checksum)
+        {
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                return false;
+            struct stat st;
+            if (::fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(FileHeader))
+            {
+                ::close(fd);
+                return false;
+            }
+            void *addr = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd); // 映射建立后就可以关闭fd
+            if (addr == MAP_FAILED)
+                return false;
+
+            const FileHeader *header = (const FileHeader *)addr;
+            if (!Verify(header, st.st_size) || header->source_size != source_size || header->source_checksum != source_checksum)
+            {
+                ::munmap(addr, st.st_size);
+                return false;
+            }
+
+            Unmap();
+            _map = addr;
+            _map_len = st.st_size;
+            // 正文按需访问，不需要内核预读
+            ::madvise(_map, _map_len, MADV_RANDOM);
+            const char *base = (const char *)addr;
+            _block_tab = (const BlockMeta *)(base + sizeof(FileHeader));
+            _block_cnt = header->block_count;
+            _doc_tab = (const DocMeta *)(base + sizeof(FileHeader) + _block_cnt * sizeof(BlockMeta));
+            _doc_cnt = header->doc_count;
+            _data = base + header->data_offset;
+
+            // 内存里建的副本可以释放了
+            std::vector<BlockMeta>().swap(_blocks);
+            std::vector<DocMeta>().swap(_docs);
+            std::string().swap(_blob);
+            std::string().swap(_pending);
+            ClearCache();
+            return true;
+        }
+
+        // 丢掉已经打开或者建好的内容，回到刚构造时的状态，重新Add
+        void Reset()
+        {
+            Unmap();
+            _block_tab = nullptr;
+            _block_cnt = 0;
+            _doc_tab = nullptr;
+            _doc_cnt = 0;
+            _data = nullptr;
+            std::vector<BlockMeta>().swap(_blocks);
+            std::vector<DocMeta>().swap(_docs);
+            std::string().swap(_blob);
+            std::string().swap(_pending);
+            ClearCache();
+        }
+
+        // 文件内容的校验和（FNV-1a，每次取8字节），用来判断raw.txt变没变
+        static bool FileChecksum(const std::string &path, uint64_t *checksum)
+        {
+            std::ifstream in(path, std::ios::in | std::ios::binary);
+            if (!in.is_open())
+                return false;
+            uint64_t h = 14695981039346656037ULL;
+            std::vector<char> buf(1 << 16); // 8的倍数，只有最后一段会剩下不满8字节的尾巴
+            while (in)
+            {
+                in.read(buf.data(), buf.size());
+                size_t len = in.gcount();
+                const char *p = buf.data();
+                for (; len >= 8; p += 8, len -= 8)
+                {
+                    uint64_t word;
+                    std::memcpy(&word, p, 8);
+                    h = (h ^ word) * 1099511628211ULL;
+                }
+                for (; len > 0; p++, len--)
+                    h = (h ^ (unsigned char)*p) * 1099511628211ULL;
+            }
+            *checksum = h;
+            return true;
+        }
+
+        bool Get(uint64_t doc_id, DocView *doc)
+        {
+            if (doc_id >= _doc_cnt)
+                return false;
+            const DocMeta &meta = _doc_tab[doc_id];
+            const char *p = nullptr;
+            if (_codec == CODEC_NONE)
+            {
+                p = _data + _block_tab[meta.block].offset + meta.offset;
+                doc->hold.reset();
+            }
+            else
+            {
+                BlockPtr block = LoadBlock(meta.block);
+                if (!block)
+                    return false;
+                p = block->data() + meta.offset;
+                doc->hold = block;
+            }
+            doc->doc_id = doc_id;
+            doc->title = ns_util::StringView(p, meta.title_len);
+            p += meta.title_len;
+            doc->content = ns_util::StringView(p, meta.content_len);
+            p += meta.content_len;
+            doc->url = ns_util::StringView(p, meta.url_len);
+            return true;
+        }
+
+        size_t Size() const { return _doc_cnt; }
+        bool IsMapped() const { return _map != nullptr; }
+
+    private:
+        // 头部、块表、文档表都要落在文件里：块在数据区内，文档在所在块解压后的范围内
+        bool Verify(const FileHeader *header, uint64_t file_size) const
+        {
+            if (std::memcmp(header->magic, Magic(), sizeof(header->magic)) != 0 || header->version != VERSION ||
+                header->codec != (uint32_t)_codec)
+                return false;
+            uint64_t room = file_size - sizeof(FileHeader);
+            if (header->block_count > room / sizeof(BlockMeta) ||
+                header->doc_count > (room - header->block_count * sizeof(BlockMeta)) / sizeof(DocMeta))
+                return false;
+            uint64_t tables = sizeof(FileHeader) + header->block_count * sizeof(BlockMeta) + header->doc_count * sizeof(DocMeta);
+            if (header->data_offset != tables || header->data_len != file_size - tables)
+                return false;
+            const BlockMeta *blocks = (const BlockMeta *)(header + 1);
+            const DocMeta *docs = (const DocMeta *)(blocks + header->block_count);
+            for (uint64_t i = 0; i < header->block_count; i++)
+            {
+                const BlockMeta &b = blocks[i];
+                if (b.offset > header->data_len || b.comp_len > header->data_len - b.offset ||
+                    (_codec == CODEC_NONE && b.comp_len != b.raw_len))
+                    return false;
+            }
+            for (uint64_t i = 0; i < header->doc_count; i++)
+            {
+                const DocMeta &d = docs[i];
+                if (d.block >= header->block_count)
+                    return false;
+                uint64_t len = (uint64_t)d.offset + d.title_len + d.content_len + d.url_len;
+                if (len > blocks[d.block].raw_len)
+                    return false;
+            }
+            return true;
+        }
+
+        void ClearCache()
+        {
+            std::lock_guard<std::mutex> lock(_cache_mtx);
+            _cache.clear();
+            _lru.clear();
+        }
+
+        void FlushBlock()
+        {
+            BlockMeta meta;
+            meta.offset = _blob.size();
+            meta.raw_len = (uint32_t)_pending.size();
+            if (_codec == CODEC_LZ)
+            {
+                std::string comp;
+                LzCodec::Compress(_pending.data(), _pending.size(), &comp);
+                _blob += comp;
+                meta.comp_len = (uint32_t)comp.size();
+            }
+            else
+            {
+                _blob += _pending;
+                meta.comp_len = meta.raw_len;
+            }
+            _blocks.push_back(meta);
+            _pending.clear();
+        }
+
+        BlockPtr LoadBlock(uint32_t block_id)
+        {
+            std::lock_guard<std::mutex> lock(_cache_mtx);
+            auto iter = _cache.find(block_id);
+            if (iter != _cache.end())
+            {
+                // 命中，移动到LRU链表头部
+                _lru.splice(_lru.begin(), _lru, iter->second.second);
+                return iter->second.first;
+            }
+
+            const BlockMeta &meta = _block_tab[block_id];
+            std::shared_ptr<std::string> raw = std::make_shared<std::string>();
+            if (!LzCodec::Decompress(_data + meta.offset, meta.comp_len, meta.raw_len, raw.get()))
+            {
+                LOG(ERROR) << "decompress block " << block_id << " error!";
+                return BlockPtr();
+            }
+
+            if (_cache.size() >= _cache_blocks)
+            {
+                _cache.erase(_lru.back());
+                _lru.pop_back();
+            }
+            _lru.push_front(block_id);
+            _cache[block_id] = std::make_pair(BlockPtr(raw), _lru.begin());
+            return raw;
+        }
+
+        void Unmap()
+        {
+            if (_map != nullptr)
+            {
+                ::munmap(_map, _map_len);
+                _map = nullptr;
+                _map_len = 0;
+            }
+        }
+
+    private:
+        static const char *Magic() { return "BSDSTORE"; }
+        static const uint32_t VERSION = 2;
+
+        Codec _codec;
+        size_t _block_size;
+        size_t _cache_blocks;
+
+        // 建索引阶段使用的内存副本
+        std::string _pending;           // 正在填充的块
+        std::string _blob;              // 所有块首尾相接
+        std::vector<BlockMeta> _blocks; // 块表
+        std::vector<DocMeta> _docs;     // 文档表，下标即doc_id
+
+        // 查询阶段只通过下面几个指针访问，指向内存副本或者mmap的文件
+        void *_map = nullptr;
+        size_t _map_len = 0;
+        const BlockMeta *_block_tab = nullptr;
+        size_t _block_cnt = 0;
+        const DocMeta *_doc_tab = nullptr;
+        size_t _doc_cnt = 0;
+        const char *_data = nullptr;
+
+        std::mutex _cache_mtx;
+        std::list<uint32_t> _lru;
+        std::unordered_map<uint32_t, std::pair<BlockPtr, std::list<uint32_t>::iterator>> _cache;
+    };
+}
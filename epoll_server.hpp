@@ -0,0 +1,956 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <signal.h>
+#include "log.hpp"
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+namespace ns_epoll
+{
+    // 解析好的请求。成员名和httplib::Request一致，路由处理函数可以两边共用
+    struct Request
+    {
+        std::string method;
+        std::string path;
+        std::string version;
+        std::string body;
+        std::multimap<std::string, std::string> params;  // 已经url解码
+        std::multimap<std::string, std::string> headers; // key转成了小写
+
+        bool has_param(const char *key) const { return params.find(key) != params.end(); }
+        std::string get_param_value(const char *key) const
+        {
+            auto it = params.find(key);
+            return it == params.end() ? std::string() : it->second;
+        }
+        bool has_header(const char *key) const { return headers.find(Lower(key)) != headers.end(); }
+        std::string get_header_value(const char *key) const
+        {
+            auto it = headers.find(Lower(key));
+            return it == headers.end() ? std::string() : it->second;
+        }
+
+        static std::string Lower(std::string s)
+        {
+            for (auto &c : s)
+            {
+                if (c >= 'A' && c <= 'Z')
+                    c += 'a' - 'A';
+            }
+            return s;
+        }
+    };
+
+    struct Response
+    {
+        int status = 200;
+        std::string body;
+        std::vector<std::pair<std::string, std::string>> headers;
+        std::string file;     // 非空时响应体是这个文件（忽略body），用sendfile发送
+        size_t file_size = 0;
+
+        void set_header(const char *key, const std::string &value)
+        {
+            for (auto &h : headers)
+            {
+                if (strcasecmp(h.first.c_str(), key) == 0)
+                {
+                    h.second = value;
+                    return;
+                }
+            }
+            headers.push_back(std::make_pair(std::string(key), value));
+        }
+        std::string get_header_value(const char *key) const
+        {
+            for (auto &h : headers)
+            {
+                if (strcasecmp(h.first.c_str(), key) == 0)
+                    return h.second;
+            }
+            return std::string();
+        }
+        void set_content(const std::string &s, const char *content_type)
+        {
+            body = s;
+            set_header("Content-Type", content_type);
+        }
+    };
+
+    typedef std::function<void(const Request &, Response &)> Handler;
+
+    struct Options
+    {
+        std::string address = "0.0.0.0";
+        int port = 8081;
+        int backlog = 1024;
+        size_t loops = 0;                 // 事件循环个数，0表示取CPU核数
+        size_t threads = 8;               // 处理耗时请求的工作线程数
+        size_t max_queued = 1024;         // 工作线程排队上限，满了回503
+        size_t keep_alive_max_count = 100;
+        time_t keep_alive_timeout = 5;
+        size_t payload_max_length = 64 * 1024;
+        size_t max_header_size = 8 * 1024;
+    };
+
+    // 有界任务队列的线程池，队列满时TryPush返回false
+    class WorkerPool
+    {
+    public:
+        WorkerPool(size_t threads, size_t max_queued) : _max_queued(max_queued), _stop(false)
+        {
+            for (size_t i = 0; i < threads; i++)
+                _threads.emplace_back([this]
+                                      { Work(); });
+        }
+        ~WorkerPool()
+        {
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                _stop = true;
+            }
+            _cond.notify_all();
+            for (auto &t : _threads)
+                t.join();
+        }
+
+        bool TryPush(std::function<void()> task)
+        {
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                if (_max_queued > 0 && _tasks.size() >= _max_queued)
+                    return false;
+                _tasks.push_back(std::move(task));
+            }
+            _cond.notify_one();
+            return true;
+        }
+
+    private:
+        void Work()
+        {
+            for (;;)
+            {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(_mtx);
+                    _cond.wait(lock, [this]
+                               { return _stop || !_tasks.empty(); });
+                    if (_stop && _tasks.empty())
+                        return;
+                    task = std::move(_tasks.front());
+                    _tasks.pop_front();
+                }
+                task();
+            }
+        }
+
+        size_t _max_queued;
+        bool _stop;
+        std::vector<std::thread> _threads;
+        std::deque<std::function<void()>> _tasks;
+        std::mutex _mtx;
+        std::condition_variable _cond;
+    };
+
+    // 基于epoll的HTTP/1.1服务器：每个核一个事件循环，各自用SO_REUSEPORT监听同一个端口，
+    // 连接是非阻塞+边缘触发的，空闲的长连接只占一个fd和一点缓冲区，不占线程。
+    // 标记为offload的路由（比如/s）交给工作线程池，做完后通过eventfd通知所在的事件循环写回；
+    // 其余路由直接在事件循环里处理
+    class EpollServer
+    {
+    public:
+        explicit EpollServer(const Options &opt) : _opt(opt) {}
+
+        // path精确匹配，GET和HEAD都会走到这里
+        void Get(const std::string &path, Handler handler, bool offload = false)
+        {
+            Route route;
+            route.handler = std::move(handler);
+            route.offload = offload;
+            _routes[path] = std::move(route);
+        }
+
+        // path精确匹配，只接受POST，用于会改状态的接口
+        void Post(const std::string &path, Handler handler, bool offload = false)
+        {
+            Route route;
+            route.handler = std::move(handler);
+            route.offload = offload;
+            route.post = true;
+            _routes[path] = std::move(route);
+        }
+
+        // 没有匹配的路由时调用（比如静态文件），没设置就回404
+        void SetFallback(Handler handler) { _fallback = std::move(handler); }
+
+        // 阻塞运行，监听失败返回false
+        bool Run()
+        {
+            // 对端关闭后再写会收到SIGPIPE，默认动作是杀掉进程。sendfile没有MSG_NOSIGNAL，只能整个进程忽略
+            ::signal(SIGPIPE, SIG_IGN);
+            size_t n = _opt.loops;
+            if (n == 0)
+                n = std::thread::hardware_concurrency();
+            if (n == 0)
+                n = 1;
+            _pool.reset(new WorkerPool(_opt.threads, _opt.max_queued));
+            std::vector<std::unique_ptr<Loop>> loops;
+            for (size_t i = 0; i < n; i++)
+            {
+                std::unique_ptr<Loop> loop(new Loop(this));
+                if (!loop->Init())
+                    return false;
+                loops.push_back(std::move(loop));
+            }
+            std::vector<std::thread> threads;
+            for (size_t i = 1; i < n; i++)
+            {
+                Loop *loop = loops[i].get();
+                threads.emplace_back([loop]
+                                     { loop->Run(); });
+                PinToCore(threads.back().native_handle(), i);
+            }
+            PinToCore(pthread_self(), 0);
+            loops[0]->Run();
+            for (auto &t : threads)
+                t.join();
+            return true;
+        }
+
+    private:
+        struct Route
+        {
+            Handler handler;
+            bool offload = false;
+            bool post = false; // true只接受POST，否则接受GET和HEAD
+        };
+
+        static void PinToCore(pthread_t thread, size_t i)
+        {
+            size_t cores = std::thread::hardware_concurrency();
+            if (cores == 0)
+                return;
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(i % cores, &set);
+            pthread_setaffinity_np(thread, sizeof(set), &set);
+        }
+
+        static const char *Reason(int status)
+        {
+            switch (status)
+            {
+            case 200:
+                return "OK";
+            case 304:
+                return "Not Modified";
+            case 400:
+                return "Bad Request";
+            case 403:
+                return "Forbidden";
+            case 404:
+                return "Not Found";
+            case 405:
+                return "Method Not Allowed";
+            case 413:
+                return "Payload Too Large";
+            case 431:
+                return "Request Header Fields Too Large";
+            case 500:
+                return "Internal Server Error";
+            case 501:
+                return "Not Implemented";
+            case 503:
+                return "Service Unavailable";
+            default:
+                return "Unknown";
+            }
+        }
+
+        static int FromHex(char c)
+        {
+            if (c >= '0' && c <= '9')
+                return c - '0';
+            if (c >= 'a' && c <= 'f')
+                return c - 'a' + 10;
+            if (c >= 'A' && c <= 'F')
+                return c - 'A' + 10;
+            return -1;
+        }
+
+        // %xx解码，查询串里的+是空格
+        static std::string DecodeUrl(const char *p, size_t n, bool plus_as_space)
+        {
+            std::string out;
+            out.reserve(n);
+            for (size_t i = 0; i < n; i++)
+            {
+                if (p[i] == '%' && i + 2 < n)
+                {
+                    int hi = FromHex(p[i + 1]);
+                    int lo = FromHex(p[i + 2]);
+                    if (hi >= 0 && lo >= 0)
+                    {
+                        out.push_back((char)(hi * 16 + lo));
+                        i += 2;
+                        continue;
+                    }
+                }
+                out.push_back(plus_as_space && p[i] == '+' ? ' ' : p[i]);
+            }
+            return out;
+        }
+
+        static void ParseQuery(const std::string &query, Request *req)
+        {
+            size_t pos = 0;
+            while (pos <= query.size())
+            {
+                size_t amp = query.find('&', pos);
+                if (amp == std::string::npos)
+                    amp = query.size();
+                if (amp > pos)
+                {
+                    size_t eq = query.find('=', pos);
+                    if (eq == std::string::npos || eq > amp)
+                        eq = amp;
+                    std::string key = DecodeUrl(query.data() + pos, eq - pos, true);
+                    std::string value = eq < amp ? DecodeUrl(query.data() + eq + 1, amp - eq - 1, true) : std::string();
+                    req->params.insert(std::make_pair(std::move(key), std::move(value)));
+                }
+                pos = amp + 1;
+            }
+        }
+
+        enum ParseResult
+        {
+            PARSE_MORE,  // 数据还不够一个完整请求
+            PARSE_OK,
+            PARSE_ERROR, // status里是要回的错误码，回完就关闭连接
+        };
+
+        // 从in的开头解析一个请求，成功时consumed是这个请求占的字节数
+        ParseResult Parse(const std::string &in, Request *req, size_t *consumed, int *status) const
+        {
+            size_t end = in.find("\r\n\r\n");
+            if (end == std::string::npos)
+            {
+                if (in.size() > _opt.max_header_size)
+                {
+                    *status = 431;
+                    return PARSE_ERROR;
+                }
+                return PARSE_MORE;
+            }
+            if (end > _opt.max_header_size)
+            {
+                *status = 431;
+                return PARSE_ERROR;
+            }
+            *status = 400;
+            // 请求行：METHOD target VERSION
+            size_t line_end = in.find("\r\n");
+            size_t sp1 = in.find(' ');
+            size_t sp2 = sp1 == std::string::npos ? sp1 : in.find(' ', sp1 + 1);
+            if (sp1 == std::string::npos || sp2 == std::string::npos || sp2 > line_end)
+                return PARSE_ERROR;
+            req->method = in.substr(0, sp1);
+            std::string target = in.substr(sp1 + 1, sp2 - sp1 - 1);
+            req->version = in.substr(sp2 + 1, line_end - sp2 - 1);
+            if (target.empty() || target[0] != '/' || req->version.compare(0, 5, "HTTP/") != 0)
+                return PARSE_ERROR;
+            size_t qmark = target.find('?');
+            req->path = DecodeUrl(target.data(), qmark == std::string::npos ? target.size() : qmark, false);
+            if (qmark != std::string::npos)
+                ParseQuery(target.substr(qmark + 1), req);
+
+            // 头部
+            size_t pos = line_end + 2;
+            while (pos < end)
+            {
+                size_t eol = in.find("\r\n", pos);
+                size_t colon = in.find(':', pos);
+                if (colon == std::string::npos || colon > eol)
+                    return PARSE_ERROR;
+                std::string key = Request::Lower(in.substr(pos, colon - pos));
+                size_t vb = colon + 1;
+                while (vb < eol && (in[vb] == ' ' || in[vb] == '\t'))
+                    ++vb;
+                size_t ve = eol;
+                while (ve > vb && (in[ve - 1] == ' ' || in[ve - 1] == '\t'))
+                    --ve;
+                req->headers.insert(std::make_pair(std::move(key), in.substr(vb, ve - vb)));
+                pos = eol + 2;
+            }
+
+            if (req->has_header("transfer-encoding"))
+            {
+                *status = 501;
+                return PARSE_ERROR;
+            }
+            size_t body_len = 0;
+            if (req->has_header("content-length"))
+            {
+                std::string len = req->get_header_value("content-length");
+                char *p = nullptr;
+                body_len = std::strtoul(len.c_str(), &p, 10);
+                if (len.empty() || *p != '\0')
+                    return PARSE_ERROR;
+                if (body_len > _opt.payload_max_length)
+                {
+                    *status = 413;
+                    return PARSE_ERROR;
+                }
+            }
+            if (in.size() < end + 4 + body_len)
+                return PARSE_MORE;
+            req->body = in.substr(end + 4, body_len);
+            *consumed = end + 4 + body_len;
+            return PARSE_OK;
+        }
+
+        static bool WantKeepAlive(const Request &req)
+        {
+            std::string conn = Request::Lower(req.get_header_value("connection"));
+            if (req.version == "HTTP/1.0")
+                return conn == "keep-alive";
+            return conn != "close";
+        }
+
+        static void Serialize(const Response &resp, bool keep_alive, bool head, std::string *out)
+        {
+            char line[64];
+            int n = std::snprintf(line, sizeof(line), "HTTP/1.1 %d ", resp.status);
+            out->append(line, n);
+            out->append(Reason(resp.status));
+            out->append("\r\n");
+            bool has_type = false;
+            for (auto &h : resp.headers)
+            {
+                if (strcasecmp(h.first.c_str(), "Content-Length") == 0 || strcasecmp(h.first.c_str(), "Connection") == 0)
+                    continue;
+                if (strcasecmp(h.first.c_str(), "Content-Type") == 0)
+                    has_type = true;
+                out->append(h.first);
+                out->append(": ");
+                out->append(h.second);
+                out->append("\r\n");
+            }
+            if (!has_type && !resp.body.empty())
+                out->append("Content-Type: text/plain\r\n");
+            n = std::snprintf(line, sizeof(line), "Content-Length: %zu\r\n", resp.file.empty() ? resp.body.size() : resp.file_size);
+            out->append(line, n);
+            out->append(keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
+            if (!head && resp.file.empty())
+                out->append(resp.body);
+        }
+
+        // 一个事件循环：自己的epoll、监听socket和连接表，只在自己的线程里访问
+        class Loop
+        {
+        public:
+            explicit Loop(EpollServer *svr) : _svr(svr), _epfd(-1), _listen_fd(-1), _event_fd(-1), _seq(0) {}
+            ~Loop()
+            {
+                for (Conn *c : _conns)
+                {
+                    if (c != nullptr)
+                    {
+                        ::close(c->fd);
+                        if (c->file_fd >= 0)
+                            ::close(c->file_fd);
+                        delete c;
+                    }
+                }
+                if (_listen_fd >= 0)
+                    ::close(_listen_fd);
+                if (_event_fd >= 0)
+                    ::close(_event_fd);
+                if (_epfd >= 0)
+                    ::close(_epfd);
+            }
+
+            bool Init()
+            {
+                _epfd = epoll_create1(EPOLL_CLOEXEC);
+                _event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                if (_epfd < 0 || _event_fd < 0)
+                {
+                    LOG(ERROR) << "epoll_create1/eventfd error: " << std::strerror(errno);
+                    return false;
+                }
+                if (!Listen())
+                    return false;
+                struct epoll_event ev;
+                std::memset(&ev, 0, sizeof(ev));
+                ev.events = EPOLLIN | EPOLLET;
+                ev.data.fd = _listen_fd;
+                epoll_ctl(_epfd, EPOLL_CTL_ADD, _listen_fd, &ev);
+                ev.data.fd = _event_fd;
+                epoll_ctl(_epfd, EPOLL_CTL_ADD, _event_fd, &ev);
+                return true;
+            }
+
+            void Run()
+            {
+                const int MAX_EVENTS = 1024;
+                struct epoll_event events[MAX_EVENTS];
+                time_t last_sweep = time(nullptr);
+                for (;;)
+                {
+                    int n = epoll_wait(_epfd, events, MAX_EVENTS, 1000);
+                    if (n < 0 && errno != EINTR)
+                    {
+                        LOG(ERROR) << "epoll_wait error: " << std::strerror(errno);
+                        return;
+                    }
+                    _now = time(nullptr);
+                    for (int i = 0; i < n; i++)
+                    {
+                        int fd = events[i].data.fd;
+                        uint32_t e = events[i].events;
+                        if (fd == _listen_fd)
+                        {
+                            Accept();
+                            continue;
+                        }
+                        if (fd == _event_fd)
+                        {
+                            DrainCompletions();
+                            continue;
+                        }
+                        Conn *c = Find(fd);
+                        if (c == nullptr)
+                            continue;
+                        if (e & (EPOLLERR | EPOLLHUP))
+                        {
+                            Close(c);
+                            continue;
+                        }
+                        if (e & (EPOLLIN | EPOLLRDHUP))
+                        {
+                            if (!OnReadable(c))
+                                continue;
+                        }
+                        if ((e & EPOLLOUT) && Flush(c) && !c->busy && c->file_fd < 0)
+                            Process(c); // 文件发完了，接着处理流水线里后面的请求
+                    }
+                    if (_now != last_sweep)
+                    {
+                        last_sweep = _now;
+                        SweepIdle();
+                    }
+                }
+            }
+
+        private:
+            struct Conn
+            {
+                int fd = -1;
+                uint64_t seq = 0;    // 区分复用同一个fd的不同连接
+                std::string in;      // 收到还没处理的数据
+                std::string out;     // 还没写出去的响应
+                size_t out_off = 0;
+                size_t served = 0;   // 已经回了多少个请求
+                bool busy = false;   // 有请求在工作线程里，先不处理后面的请求（保证响应顺序）
+                bool closing = false; // 写完out就关闭
+                bool pending_close = false; // 工作线程里的请求回完之后关闭
+                bool eof = false;    // 对端已经不再发数据
+                int file_fd = -1;    // 正在用sendfile发送的文件，发完之前不处理后面的请求
+                off_t file_off = 0;
+                size_t file_left = 0;
+                time_t last = 0;     // 最后一次活动时间
+            };
+
+            // 工作线程做完的请求
+            struct Completion
+            {
+                int fd;
+                uint64_t seq;
+                bool keep_alive;
+                bool head;
+                Response resp;
+            };
+
+            bool Listen()
+            {
+                const Options &opt = _svr->_opt;
+                struct addrinfo hints, *res = nullptr;
+                std::memset(&hints, 0, sizeof(hints));
+                hints.ai_family = AF_UNSPEC;
+                hints.ai_socktype = SOCK_STREAM;
+                hints.ai_flags = AI_PASSIVE;
+                std::string port = std::to_string(opt.port);
+                int ret = getaddrinfo(opt.address.c_str(), port.c_str(), &hints, &res);
+                if (ret != 0)
+                {
+                    LOG(ERROR) << "getaddrinfo " << opt.address << " error: " << gai_strerror(ret);
+                    return false;
+                }
+                for (struct addrinfo *ai = res; ai != nullptr; ai = ai->ai_next)
+                {
+                    int fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+                    if (fd < 0)
+                        continue;
+                    int yes = 1;
+                    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+                    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)); // 每个事件循环一个监听socket，内核负责分连接
+                    if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, opt.backlog) == 0)
+                    {
+                        _listen_fd = fd;
+                        break;
+                    }
+                    ::close(fd);
+                }
+                freeaddrinfo(res);
+                if (_listen_fd < 0)
+                {
+                    LOG(ERROR) << "listen " << opt.address << ":" << opt.port << " error: " << std::strerror(errno);
+                    return false;
+                }
+                return true;
+            }
+
+            void Accept()
+            {
+                for (;;)
+                {
+                    int fd = accept4(_listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                    if (fd < 0)
+                    {
+                        if (errno == EINTR)
+                            continue;
+                        if (errno != EAGAIN && errno != EWOULDBLOCK)
+                        {
+                            LOG_RATE(ERROR, 1) << "accept error: " << std::strerror(errno);
+                        }
+                        return; // EMFILE时下一次有新连接再试
+                    }
+                    int yes = 1;
+                    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+                    Conn *c = new Conn();
+                    c->fd = fd;
+                    c->seq = ++_seq;
+                    c->last = _now;
+                    if ((size_t)fd >= _conns.size())
+                        _conns.resize(fd + 1, nullptr);
+                    _conns[fd] = c;
+                    struct epoll_event ev;
+                    std::memset(&ev, 0, sizeof(ev));
+                    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+                    ev.data.fd = fd;
+                    if (epoll_ctl(_epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+                        Close(c);
+                }
+            }
+
+            Conn *Find(int fd) const { return (size_t)fd < _conns.size() ? _conns[fd] : nullptr; }
+
+            void Close(Conn *c)
+            {
+                epoll_ctl(_epfd, EPOLL_CTL_DEL, c->fd, nullptr);
+                ::close(c->fd);
+                if (c->file_fd >= 0)
+                    ::close(c->file_fd);
+                _conns[c->fd] = nullptr;
+                delete c;
+            }
+
+            // 边缘触发：一直读到EAGAIN。连接被关闭时返回false
+            bool OnReadable(Conn *c)
+            {
+                const Options &opt = _svr->_opt;
+                char buf[16 * 1024];
+                for (;;)
+                {
+                    ssize_t n = ::read(c->fd, buf, sizeof(buf));
+                    if (n > 0)
+                    {
+                        c->in.append(buf, n);
+                        if (c->in.size() > opt.max_header_size + opt.payload_max_length + 4)
+                        {
+                            Close(c); // 不处理也不停发数据的客户端
+                            return false;
+                        }
+                        continue;
+                    }
+                    if (n < 0 && errno == EINTR)
+                        continue;
+                    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                        break;
+                    if (n == 0)
+                    {
+                        c->eof = true; // 对端关闭了写，已经收到的请求还是要回
+                        break;
+                    }
+                    Close(c);
+                    return false;
+                }
+                c->last = _now;
+                return Process(c);
+            }
+
+            // 处理in里所有完整的请求，直到遇到交给工作线程的请求。连接被关闭时返回false
+            bool Process(Conn *c)
+            {
+                const Options &opt = _svr->_opt;
+                while (!c->busy && !c->closing && c->file_fd < 0 && !c->in.empty())
+                {
+                    Request req;
+                    size_t consumed = 0;
+                    int status = 0;
+                    ParseResult r = _svr->Parse(c->in, &req, &consumed, &status);
+                    if (r == PARSE_MORE)
+                        break;
+                    if (r == PARSE_ERROR)
+                    {
+                        Response resp;
+                        resp.status = status;
+                        c->in.clear();
+                        c->closing = true;
+                        Serialize(resp, false, false, &c->out);
+                        break;
+                    }
+                    c->in.erase(0, consumed);
+                    bool head = req.method == "HEAD";
+                    bool keep_alive = WantKeepAlive(req) && c->served + 1 < opt.keep_alive_max_count;
+                    ++c->served;
+                    if (!keep_alive)
+                        c->closing = true;
+
+                    Response resp;
+                    bool post = req.method == "POST";
+                    if (req.method != "GET" && !head && !post)
+                    {
+                        resp.status = 501;
+                        Queue(c, resp, keep_alive, head);
+                        continue;
+                    }
+                    auto found = _svr->_routes.find(req.path);
+                    if (found != _svr->_routes.end() ? found->second.post != post : post)
+                    {
+                        // 方法和路由不符；POST没有兜底处理
+                        resp.status = found != _svr->_routes.end() ? 405 : 404;
+                        if (resp.status == 405)
+                            resp.set_header("Allow", found->second.post ? "POST" : "GET, HEAD");
+                        Queue(c, resp, keep_alive, head);
+                        continue;
+                    }
+                    if (found != _svr->_routes.end() && found->second.offload)
+                    {
+                        // 交给工作线程，做完之后由DrainCompletions写回
+                        Handler *handler = &found->second.handler;
+                        std::shared_ptr<Request> shared(new Request(std::move(req)));
+                        int fd = c->fd;
+                        uint64_t seq = c->seq;
+                        Loop *self = this;
+                        if (_svr->_pool->TryPush([self, handler, shared, fd, seq, keep_alive, head]
+                                                 {
+                                                     Completion done;
+                                                     done.fd = fd;
+                                                     done.seq = seq;
+                                                     done.keep_alive = keep_alive;
+                                                     done.head = head;
+                                                     Invoke(*handler, *shared, done.resp);
+                                                     self->Complete(std::move(done)); }))
+                        {
+                            c->busy = true;
+                            c->closing = false; // 等响应写完再决定是否关闭
+                            c->pending_close = !keep_alive;
+                            continue;
+                        }
+                        resp.status = 503; // 工作线程忙不过来，直接拒绝
+                        resp.set_header("Retry-After", "1");
+                    }
+                    else if (found != _svr->_routes.end())
+                    {
+                        Invoke(found->second.handler, req, resp);
+                    }
+                    else if (_svr->_fallback)
+                    {
+                        Invoke(_svr->_fallback, req, resp);
+                    }
+                    else
+                    {
+                        resp.status = 404;
+                    }
+                    Queue(c, resp, keep_alive, head);
+                }
+                if (c->eof && !c->busy)
+                    c->closing = true;
+                return Flush(c);
+            }
+
+            static void Invoke(const Handler &handler, const Request &req, Response &resp)
+            {
+                try
+                {
+                    handler(req, resp);
+                }
+                catch (const std::exception &e)
+                {
+                    LOG(ERROR) << "handler " << req.path << " error: " << e.what();
+                    resp = Response();
+                    resp.status = 500;
+                }
+            }
+
+            // 响应头和内存里的响应体追加到out，响应体是文件时打开文件，等out写完后用sendfile发
+            void Queue(Conn *c, const Response &resp, bool keep_alive, bool head)
+            {
+                Serialize(resp, keep_alive, head, &c->out);
+                if (resp.file.empty() || head || resp.file_size == 0)
+                    return;
+                int fd = ::open(resp.file.c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd < 0)
+                {
+                    // 响应头已经写了长度，只能发完头就关闭连接
+                    LOG(ERROR) << "open " << resp.file << " error: " << std::strerror(errno);
+                    c->closing = true;
+                    return;
+                }
+                c->file_fd = fd;
+                c->file_off = 0;
+                c->file_left = resp.file_size;
+            }
+
+            // 尽量把out和文件写完，写完并且需要关闭时关闭连接。连接被关闭时返回false
+            bool Flush(Conn *c)
+            {
+                while (c->out_off < c->out.size())
+                {
+                    ssize_t n = ::send(c->fd, c->out.data() + c->out_off, c->out.size() - c->out_off, MSG_NOSIGNAL);
+                    if (n > 0)
+                    {
+                        c->out_off += n;
+                        continue;
+                    }
+                    if (n < 0 && errno == EINTR)
+                        continue;
+                    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                        return true; // 等EPOLLOUT
+                    Close(c);
+                    return false;
+                }
+                c->out.clear();
+                c->out_off = 0;
+                while (c->file_fd >= 0)
+                {
+                    ssize_t n = sendfile(c->fd, c->file_fd, &c->file_off, c->file_left);
+                    if (n > 0)
+                    {
+                        c->file_left -= n;
+                        if (c->file_left == 0)
+                        {
+                            ::close(c->file_fd);
+                            c->file_fd = -1;
+                        }
+                        continue;
+                    }
+                    if (n < 0 && errno == EINTR)
+                        continue;
+                    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                        return true; // 等EPOLLOUT
+                    Close(c); // 出错，或者文件在发送过程中变短了
+                    return false;
+                }
+                c->last = _now;
+                if (c->closing && !c->busy)
+                {
+                    Close(c);
+                    return false;
+                }
+                return true;
+            }
+
+            // 工作线程调用：放进完成队列，用eventfd唤醒事件循环
+            void Complete(Completion &&done)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(_mtx);
+                    _done.push_back(std::move(done));
+                }
+                uint64_t one = 1;
+                ssize_t n = ::write(_event_fd, &one, sizeof(one));
+                (void)n;
+            }
+
+            void DrainCompletions()
+            {
+                uint64_t cnt;
+                while (::read(_event_fd, &cnt, sizeof(cnt)) > 0)
+                    ;
+                std::vector<Completion> done;
+                {
+                    std::unique_lock<std::mutex> lock(_mtx);
+                    done.swap(_done);
+                }
+                for (auto &d : done)
+                {
+                    Conn *c = Find(d.fd);
+                    if (c == nullptr || c->seq != d.seq)
+                        continue; // 连接在处理期间已经关闭
+                    Queue(c, d.resp, d.keep_alive, d.head);
+                    c->busy = false;
+                    c->closing = c->pending_close;
+                    c->pending_close = false;
+                    if (Flush(c))
+                        Process(c); // 流水线里后面的请求
+                }
+            }
+
+            // 关闭超时的空闲长连接
+            void SweepIdle()
+            {
+                time_t timeout = _svr->_opt.keep_alive_timeout;
+                for (Conn *c : _conns)
+                {
+                    if (c != nullptr && !c->busy && c->out.empty() && c->file_fd < 0 && _now - c->last >= timeout)
+                        Close(c);
+                }
+            }
+
+        private:
+            EpollServer *_svr;
+            int _epfd;
+            int _listen_fd;
+            int _event_fd;
+            uint64_t _seq;
+            time_t _now = 0;
+            std::vector<Conn *> _conns; // fd -> 连接
+
+            std::mutex _mtx;
+            std::vector<Completion> _done;
+        };
+
+    private:
+        Options _opt;
+        std::map<std::string, Route> _routes;
+        Handler _fallback;
+        std::unique_ptr<WorkerPool> _pool;
+    };
+}
@@ -1,26 +1,265 @@
 #include "httplib.h"
+#include "epoll_server.hpp"
+#include "static_cache.hpp"
 #include "searcher.hpp"
+#include "compress.hpp"
+#include "config.hpp"
 
-const std::string path = "data/raw_html/raw.txt";
+// 路由处理函数写成模板，httplib和epoll两种前端共用（两边的Request/Response成员名一致）
 
-int main()
+// 按Accept-Encoding压缩响应体，太小的或者客户端不接受的直接发原文
+template <class Req, class Resp>
+static void SetContent(const Req &req, Resp &resp, std::string &body, const char *content_type)
+{
+    resp.set_header("Vary", "Accept-Encoding");
+    ns_compress::Encoding e = ns_compress::ENCODING_NONE;
+    if (body.size() >= ns_compress::MIN_COMPRESS_SIZE && !req.has_header("Range"))
+        e = ns_compress::Negotiate(req.get_header_value("Accept-Encoding"));
+    std::string compressed;
+    if (e != ns_compress::ENCODING_NONE && ns_compress::Compress(e, body.data(), body.size(), &compressed))
+    {
+        resp.set_header("Content-Encoding", ns_compress::EncodingName(e));
+        body.swap(compressed);
+    }
+    resp.body.swap(body);
+    resp.set_header("Content-Type", content_type);
+}
+
+template <class Req, class Resp>
+static void HandleSearch(ns_searcher::Searcher &searcher, const Req &req, Resp &resp)
+{
+    if (!req.has_param("word"))
+    {
+        resp.set_content("必须要有搜索关键字", "text/plain;charset=utf-8");
+        return;
+    }
+    std::string word = req.get_param_value("word"); // 获取提交的参数
+    LOG(INFO) << "用户正在搜索 " << word;
+    // 分页：page从1开始，size每页条数，cursor是上一页返回的next
+    ns_searcher::PageRequest page;
+    if (req.has_param("page"))
+    {
+        page.page = std::strtoul(req.get_param_value("page").c_str(), nullptr, 10);
+    }
+    if (req.has_param("size"))
+    {
+        page.size = std::strtoul(req.get_param_value("size").c_str(), nullptr, 10);
+    }
+    if (req.has_param("cursor"))
+    {
+        page.cursor = req.get_param_value("cursor");
+    }
+    bool pretty = req.has_param("pretty") && req.get_param_value("pretty") == "1"; // 调试用
+    std::string out_json;
+    if (!searcher.Search(word, page, &out_json, pretty))
+    {
+        resp.status = 400;
+        resp.set_content("cursor无效", "text/plain;charset=utf-8");
+        return;
+    }
+    SetContent(req, resp, out_json, "application/json;charset=utf-8");
+}
+
+template <class Req, class Resp>
+static void HandleSuggest(ns_searcher::Searcher &searcher, const Req &req, Resp &resp)
+{
+    if (!req.has_param("prefix"))
+    {
+        resp.set_content("必须要有前缀", "text/plain;charset=utf-8");
+        return;
+    }
+    std::string prefix = req.get_param_value("prefix");
+    size_t n = 10;
+    if (req.has_param("n"))
+    {
+        n = std::strtoul(req.get_param_value("n").c_str(), nullptr, 10);
+    }
+    std::string out_json;
+    searcher.Suggest(prefix, n, &out_json);
+    SetContent(req, resp, out_json, "application/json;charset=utf-8");
+}
+
+// 比较管理口令。耗时只和收到的长度有关，不会因为前几个字节对上了就早一点返回
+static bool TokenEquals(const std::string &got, const std::string &token)
+{
+    unsigned char diff = got.size() == token.size() ? 0 : 1;
+    for (size_t i = 0; i < got.size(); i++)
+        diff |= (unsigned char)got[i] ^ (unsigned char)(token.empty() ? 0 : token[i % token.size()]);
+    return diff == 0;
+}
+
+// 管理接口：重新加载用户词典，换掉查询用的分词器，返回切得不一样的已索引词条。
+// 只接受POST，口令放在X-Admin-Token请求头里（不进URL，也就不会出现在访问日志和代理日志里），
+// 和配置的admin_token一致才执行
+template <class Req, class Resp>
+static void HandleReloadDict(ns_searcher::Searcher &searcher, const std::string &token, const Req &req, Resp &resp)
+{
+    if (!TokenEquals(req.get_header_value("X-Admin-Token"), token))
+    {
+        resp.status = 403;
+        resp.set_content("forbidden", "text/plain;charset=utf-8");
+        return;
+    }
+    LOG(INFO) << "管理接口：重新加载用户词典";
+    std::string out_json;
+    if (!searcher.ReloadUserDict(&out_json))
+    {
+        resp.status = 500;
+    }
+    SetContent(req, resp, out_json, "application/json;charset=utf-8");
+}
+
+// 静态文件：内存里的文件按Accept-Encoding直接取启动时压缩好的版本，If-None-Match命中回304。
+// 文件太大没放进内存时返回它，由各个前端自己安排发送；其余情况返回nullptr
+template <class Req, class Resp>
+static std::shared_ptr<const ns_static::StaticFile> ServeStatic(const ns_static::StaticCache &cache, const Req &req, Resp &resp)
+{
+    std::shared_ptr<const ns_static::StaticFile> file = cache.Find(req.path);
+    if (!file)
+    {
+        resp.status = 404;
+        resp.set_content("not found", "text/plain;charset=utf-8");
+        return nullptr;
+    }
+    ns_compress::Encoding e = ns_compress::ENCODING_NONE;
+    if (file->in_memory && !req.has_header("Range"))
+        e = file->Choose(ns_compress::Negotiate(req.get_header_value("Accept-Encoding")));
+    resp.set_header("ETag", file->ETag(e));
+    resp.set_header("Cache-Control", file->cache_control);
+    if (!file->gzip.empty() || !file->br.empty())
+        resp.set_header("Vary", "Accept-Encoding");
+    if (file->Matches(req.get_header_value("If-None-Match")))
+    {
+        resp.status = 304;
+        return nullptr;
+    }
+    resp.set_header("Content-Type", file->content_type);
+    if (e != ns_compress::ENCODING_NONE)
+        resp.set_header("Content-Encoding", ns_compress::EncodingName(e));
+    if (file->in_memory)
+    {
+        resp.body = file->Body(e);
+        return nullptr;
+    }
+    return file;
+}
+
+// httplib前端：线程池里的线程在一个长连接的整个生命周期里都被占着
+static int RunHttplib(const ns_config::ServerConfig &conf, ns_searcher::Searcher &searcher, const ns_static::StaticCache &cache)
 {
     httplib::Server svr;
-    ns_searcher::Searcher searcher;
-    searcher.InitSearch(path);
+    // 线程池排队的连接有上限，满了直接回503，突发流量下不会无限排队
+    size_t threads = conf.WorkerThreads(), max_queued = conf.max_queued;
+    svr.new_task_queue = [threads, max_queued]
+    { return new httplib::ThreadPool(threads, max_queued); };
+    svr.set_keep_alive_max_count(conf.keep_alive_max_count);
+    svr.set_keep_alive_timeout(conf.keep_alive_timeout);
+    svr.set_read_timeout(conf.read_timeout);
+    svr.set_write_timeout(conf.write_timeout);
+    svr.set_payload_max_length(conf.payload_max_length);
+    svr.set_listen_backlog(conf.backlog);
 
     svr.Get("/s", [&searcher](const httplib::Request &req, httplib::Response &resp)
-            { 
-                if(!req.has_param("word")){
-                    resp.set_content("必须要有搜索关键字","text/plain;charset=utf-8");
-                    return ;
-                }
-                std::string word = req.get_param_value("word");// 获取提交的参数
-                std::cout <<"用户正在搜索 "<< word << std::endl;
-                std::string out_json;
-                searcher.Search(word,&out_json);
-                resp.set_content(out_json.c_str(), "application/json;charset=utf-8"); });
-    svr.set_base_dir("./wwwroot");
-    svr.listen("0.0.0.0", 8081);
+            { HandleSearch(searcher, req, resp); });
+    svr.Get("/suggest", [&searcher](const httplib::Request &req, httplib::Response &resp)
+            { HandleSuggest(searcher, req, resp); });
+    if (!conf.admin_token.empty())
+    {
+        const std::string &token = conf.admin_token;
+        svr.Post("/admin/reload_dict", [&searcher, &token](const httplib::Request &req, httplib::Response &resp)
+                 { HandleReloadDict(searcher, token, req, resp); });
+    }
+    // 其余路径都是静态文件。httplib没有sendfile，大文件分块读出来发
+    svr.Get("/.*", [&cache](const httplib::Request &req, httplib::Response &resp)
+            {
+                std::shared_ptr<const ns_static::StaticFile> file = ServeStatic(cache, req, resp);
+                if (!file)
+                    return;
+                std::shared_ptr<std::ifstream> in(new std::ifstream(file->fs_path, std::ios::binary));
+                resp.set_content_provider(file->size, file->content_type.c_str(), [in](size_t offset, size_t length, httplib::DataSink &sink)
+                                          {
+                                              char buf[64 * 1024];
+                                              size_t n = length < sizeof(buf) ? length : sizeof(buf);
+                                              in->seekg(offset);
+                                              if (!in->read(buf, n))
+                                                  return false;
+                                              sink.write(buf, n);
+                                              return true; });
+            });
+    LOG(INFO) << "httplib listen " << conf.address << ":" << conf.port << ", " << threads << " threads";
+    if (!svr.listen(conf.address.c_str(), conf.port))
+    {
+        LOG(ERROR) << "listen " << conf.address << ":" << conf.port << " error";
+        return 1;
+    }
     return 0;
-}
\ No newline at end of file
+}
+
+// epoll前端：每个核一个事件循环，/s交给工作线程，其余请求在事件循环里直接处理
+static int RunEpoll(const ns_config::ServerConfig &conf, ns_searcher::Searcher &searcher, const ns_static::StaticCache &cache)
+{
+    ns_epoll::Options opt;
+    opt.address = conf.address;
+    opt.port = conf.port;
+    opt.backlog = conf.backlog;
+    opt.loops = conf.loops;
+    opt.threads = conf.WorkerThreads();
+    opt.max_queued = conf.max_queued;
+    opt.keep_alive_max_count = conf.keep_alive_max_count;
+    opt.keep_alive_timeout = conf.keep_alive_timeout;
+    opt.payload_max_length = conf.payload_max_length;
+    ns_epoll::EpollServer svr(opt);
+
+    svr.Get("/s", [&searcher](const ns_epoll::Request &req, ns_epoll::Response &resp)
+            { HandleSearch(searcher, req, resp); }, true);
+    svr.Get("/suggest", [&searcher](const ns_epoll::Request &req, ns_epoll::Response &resp)
+            { HandleSuggest(searcher, req, resp); });
+    // 重新加载词典要解析词典文件，放到工作线程上做
+    if (!conf.admin_token.empty())
+    {
+        const std::string &token = conf.admin_token;
+        svr.Post("/admin/reload_dict", [&searcher, &token](const ns_epoll::Request &req, ns_epoll::Response &resp)
+                 { HandleReloadDict(searcher, token, req, resp); }, true);
+    }
+    // 其余路径都是静态文件，大文件用sendfile发
+    svr.SetFallback([&cache](const ns_epoll::Request &req, ns_epoll::Response &resp)
+                    {
+                        std::shared_ptr<const ns_static::StaticFile> file = ServeStatic(cache, req, resp);
+                        if (file)
+                        {
+                            resp.file = file->fs_path;
+                            resp.file_size = file->size;
+                        } });
+    LOG(INFO) << "epoll listen " << conf.address << ":" << conf.port << ", " << opt.threads << " worker threads";
+    return svr.Run() ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+    ns_config::ServerConfig conf;
+    if (!conf.ParseArgs(argc, argv))
+    {
+        return 1;
+    }
+    ns_log::Logger::GetInstance()->SetLevel(conf.log_level);
+    if (!ns_log::Logger::GetInstance()->SetFile(conf.log_file))
+    {
+        return 1;
+    }
+
+    ns_searcher::Searcher searcher;
+    searcher.InitSearch(conf.input);
+    searcher.EnableBatching(conf.batch_window_us, conf.batch_max);
+    // 静态文件启动时全部读进内存并压缩好，目录有变化时重新加载
+    ns_static::StaticCache cache(conf.root, conf.static_max_age, conf.static_memory_limit);
+    if (!cache.Init(conf.static_watch != 0))
+    {
+        return 1;
+    }
+
+    if (conf.frontend == "epoll")
+    {
+        return RunEpoll(conf, searcher, cache);
+    }
+    return RunHttplib(conf, searcher, cache);
+}
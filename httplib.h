@@ -20,6 +20,10 @@
 #define CPPHTTPLIB_KEEPALIVE_MAX_COUNT 5
 #endif
 
+#ifndef CPPHTTPLIB_LISTEN_BACKLOG
+#define CPPHTTPLIB_LISTEN_BACKLOG 5
+#endif
+
 #ifndef CPPHTTPLIB_CONNECTION_TIMEOUT_SECOND
 #define CPPHTTPLIB_CONNECTION_TIMEOUT_SECOND 300
 #endif
@@ -493,7 +497,8 @@ public:
   TaskQueue() = default;
   virtual ~TaskQueue() = default;
 
-  virtual void enqueue(std::function<void()> fn) = 0;
+  // Returns false when the task was rejected (e.g. the queue is full).
+  virtual bool enqueue(std::function<void()> fn) = 0;
   virtual void shutdown() = 0;
 
   virtual void on_idle(){};
@@ -501,7 +506,9 @@ public:
 
 class ThreadPool : public TaskQueue {
 public:
-  explicit ThreadPool(size_t n) : shutdown_(false) {
+  // mqr: maximum number of queued (not yet running) tasks, 0 = unlimited
+  explicit ThreadPool(size_t n, size_t mqr = 0)
+      : shutdown_(false), max_queued_requests_(mqr) {
     while (n) {
       threads_.emplace_back(worker(*this));
       n--;
@@ -511,10 +518,16 @@ public:
   ThreadPool(const ThreadPool &) = delete;
   ~ThreadPool() override = default;
 
-  void enqueue(std::function<void()> fn) override {
-    std::unique_lock<std::mutex> lock(mutex_);
-    jobs_.push_back(std::move(fn));
+  bool enqueue(std::function<void()> fn) override {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (max_queued_requests_ > 0 && jobs_.size() >= max_queued_requests_) {
+        return false;
+      }
+      jobs_.push_back(std::move(fn));
+    }
     cond_.notify_one();
+    return true;
   }
 
   void shutdown() override {
@@ -564,6 +577,7 @@ private:
   std::list<std::function<void()>> jobs_;
 
   bool shutdown_;
+  size_t max_queued_requests_;
 
   std::condition_variable cond_;
   std::mutex mutex_;
@@ -638,6 +652,7 @@ public:
   void set_idle_interval(time_t sec, time_t usec = 0);
 
   void set_payload_max_length(size_t length);
+  void set_listen_backlog(int backlog);
 
   bool bind_to_port(const char *host, int port, int socket_flags = 0);
   int bind_to_any_port(const char *host, int socket_flags = 0);
@@ -665,6 +680,7 @@ protected:
   time_t idle_interval_sec_ = CPPHTTPLIB_IDLE_INTERVAL_SECOND;
   time_t idle_interval_usec_ = CPPHTTPLIB_IDLE_INTERVAL_USECOND;
   size_t payload_max_length_ = CPPHTTPLIB_PAYLOAD_MAX_LENGTH;
+  int listen_backlog_ = CPPHTTPLIB_LISTEN_BACKLOG;
 
 private:
   using Handlers = std::vector<std::pair<std::regex, Handler>>;
@@ -3994,6 +4010,10 @@ inline void Server::set_payload_max_length(size_t length) {
   payload_max_length_ = length;
 }
 
+inline void Server::set_listen_backlog(int backlog) {
+  listen_backlog_ = backlog;
+}
+
 inline bool Server::bind_to_port(const char *host, int port, int socket_flags) {
   if (bind_internal(host, port, socket_flags) < 0) return false;
   return true;
@@ -4311,11 +4331,11 @@ Server::create_server_socket(const char *host, int port, int socket_flags,
                              SocketOptions socket_options) const {
   return detail::create_socket(
       host, port, socket_flags, tcp_nodelay_, std::move(socket_options),
-      [](socket_t sock, struct addrinfo &ai) -> bool {
+      [this](socket_t sock, struct addrinfo &ai) -> bool {
         if (::bind(sock, ai.ai_addr, static_cast<socklen_t>(ai.ai_addrlen))) {
           return false;
         }
-        if (::listen(sock, 5)) { // Listen through 5 channels
+        if (::listen(sock, listen_backlog_)) {
           return false;
         }
         return true;
@@ -4386,10 +4406,24 @@ inline bool Server::listen_internal() {
       }
 
 #if __cplusplus > 201703L
-      task_queue->enqueue([=, this]() { process_and_close_socket(sock); });
+      auto queued =
+          task_queue->enqueue([=, this]() { process_and_close_socket(sock); });
 #else
-      task_queue->enqueue([=]() { process_and_close_socket(sock); });
+      auto queued =
+          task_queue->enqueue([=]() { process_and_close_socket(sock); });
 #endif
+      if (!queued) {
+        // The task queue is full: shed the connection with 503 right away
+        // instead of letting the backlog grow without bound.
+        static const char unavailable[] =
+            "HTTP/1.1 503 Service Unavailable\r\n"
+            "Content-Length: 0\r\n"
+            "Retry-After: 1\r\n"
+            "Connection: close\r\n\r\n";
+        ::send(sock, unavailable, sizeof(unavailable) - 1, 0);
+        detail::shutdown_socket(sock);
+        detail::close_socket(sock);
+      }
     }
 
     task_queue->shutdown();
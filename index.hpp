@@ -6,7 +6,10 @@
 #include <fstream>
 #include <unordered_map>
 #include <mutex>
+#include <sys/stat.h>
 #include "util.hpp"
+#include "docstore.hpp"
+#include "termdict.hpp"
 
 namespace ns_index
 {
@@ -21,7 +24,7 @@ namespace ns_index
     struct InvertElem
     {
         std::uint64_t doc_id; // 文档id
-        std::string word;     // 关键字
+        std::uint32_t word_id; // 关键字在词条字典里的id
         int weight;           // 权重
     };
 
@@ -58,133 +61,244 @@ namespace ns_index
 
     public:
         // 根据去标签的文件/data/raw_html/raw.txt，建立正排索引和倒排索引
-        // 根据doc_id找到文档内容
+        // 正排索引会落盘到raw.txt.fwd并mmap打开，raw.txt没变时下次启动直接复用
         bool BulidIndex(const std::string &path)
         {
             std::ifstream in(path, std::ios::in | std::ios::binary);
             if (!in.is_open())
             {
-                std::cerr << "open " << path << " file error" << std::endl;
+                LOG(ERROR) << "open " << path << " file error";
                 return false;
             }
+            const std::string fwd_path = path + ".fwd";
+            struct stat st;
+            uint64_t source_size = ::stat(path.c_str(), &st) == 0 ? st.st_size : 0;
+            uint64_t source_checksum = 0;
+            bool fwd_loaded = ns_docstore::DocStore::FileChecksum(path, &source_checksum) &&
+                              _forward_index.Open(fwd_path, source_size, source_checksum);
+            if (fwd_loaded)
+            {
+                LOG(INFO) << "复用已有的正排索引文件 " << fwd_path;
+            }
+
+            // 攒够一批文档一起分词，分词在多个线程上并行，统计词频和建倒排拉链还在这个线程上按文档顺序做
+            const size_t batch_size = 256;
+            std::vector<DocInfo> docs(batch_size);
             std::string line;
-            int count = 0;
-            while (std::getline(in, line))
+            size_t count = 0;
+            size_t n = 0;
+            uint64_t next_id = 0;
+            for (;;)
             {
-                // 构建正排索引
-                DocInfo *doc = BulidForwardIndex(line);
-                if (doc == nullptr)
+                bool more = (bool)std::getline(in, line);
+                // 构建正排索引（已经从文件加载时只解析，不再写入）
+                if (more && BulidForwardIndex(line, &docs[n], !fwd_loaded))
                 {
-                    continue;
+                    docs[n++].doc_id = next_id++;
                 }
-                // 构建倒排排索引
-                if (!BuildInvertedIndex(*doc))
+                if (n == batch_size || (!more && n > 0))
                 {
-                    continue;
+                    // 构建倒排排索引
+                    count += BuildInvertedIndex(&docs, n);
+                    n = 0;
+                    LOG(DEBUG) << "建立第 " << count << " 个文档索引成功";
                 }
-
-                ++count;
-                if (count % 50 == 0)
+                if (!more)
                 {
-                    std::cout << "建立第 " << count << " 个文档索引成功" << std::endl;
+                    break;
                 }
             }
             in.close();
+            // 复用的正排索引和这次解析出来的文档数对不上（文件被换过），doc_id就和倒排对不上了，重新建
+            if (fwd_loaded && _forward_index.Size() != next_id)
+            {
+                LOG(WARNING) << fwd_path << " 有 " << _forward_index.Size() << " 篇文档, " << path << " 有 " << next_id
+                             << " 篇，重新建立正排索引";
+                fwd_loaded = false;
+                if (!RebuildForwardIndex(path))
+                {
+                    return false;
+                }
+            }
+            // 建完倒排后把词条字典冻结成有序的前缀压缩数组，哈希表和Arena都释放掉
+            size_t hash_bytes = _terms.MemoryBytes();
+            _sorted_terms.Build(_terms);
+            _terms.Clear();
+            LOG(INFO) << "词条字典: " << _sorted_terms.Size() << " 个词条, " << hash_bytes << " -> "
+                      << _sorted_terms.MemoryBytes() << " 字节, 过滤停用词 " << ns_util::JiebaUtil::StopWordHits() << " 个";
+            if (!fwd_loaded)
+            {
+                _forward_index.Finish();
+                // 写盘失败就继续用内存里的副本
+                if (_forward_index.Save(fwd_path, source_size, source_checksum) &&
+                    _forward_index.Open(fwd_path, source_size, source_checksum))
+                {
+                    LOG(INFO) << "正排索引已写入 " << fwd_path;
+                }
+            }
             return true;
         }
-        DocInfo *GetForwardIndex(uint64_t doc_id)
+        // 返回的视图指向mmap的文件或者解压缓存，doc在使用期间有效
+        bool GetForwardIndex(uint64_t doc_id, ns_docstore::DocView *doc)
         {
-            if (doc_id > _forward_index.size())
+            if (!_forward_index.Get(doc_id, doc))
             {
-                std::cerr << "doc_id out of range!" << std::endl;
-                return nullptr;
+                LOG(WARNING) << "doc_id out of range!";
+                return false;
             }
-            return &_forward_index[doc_id];
+            return true;
         }
         // 根据关键字找到文档id，即获得倒排拉链
         InvertedList *GetInvertedIndex(const std::string &word)
         {
-            auto iter = _inverted_index.find(word);
-            if (iter == _inverted_index.end())
+            uint32_t word_id = _sorted_terms.Find(word);
+            if (word_id == ns_termdict::SortedTermDict::NPOS)
+            {
+                // 查询路径上很常见，限速输出，避免刷屏拖慢查询
+                LOG_RATE(DEBUG, 10) << word << " not find";
+                return nullptr;
+            }
+            return &_inverted_index[word_id];
+        }
+        // 有序词条字典，支持前缀遍历和区间扫描，value是GetInvertedList的下标
+        const ns_termdict::SortedTermDict &GetTermDict() const
+        {
+            return _sorted_terms;
+        }
+        InvertedList *GetInvertedList(uint32_t word_id)
+        {
+            if (word_id >= _inverted_index.size())
             {
-                std::cerr << word << " not find" << std::endl;
                 return nullptr;
             }
-            return &iter->second;
+            return &_inverted_index[word_id];
         }
 
     private:
-        DocInfo *BulidForwardIndex(const std::string &line)
+        // 只重新解析一遍文件建正排索引，倒排已经建好了
+        bool RebuildForwardIndex(const std::string &path)
+        {
+            std::ifstream in(path, std::ios::in | std::ios::binary);
+            if (!in.is_open())
+            {
+                LOG(ERROR) << "open " << path << " file error";
+                return false;
+            }
+            _forward_index.Reset();
+            std::string line;
+            DocInfo doc;
+            while (std::getline(in, line))
+            {
+                BulidForwardIndex(line, &doc, true);
+            }
+            return true;
+        }
+
+        bool BulidForwardIndex(const std::string &line, DocInfo *doc, bool store)
         {
             // 1.解析line，进行切分字符串
             std::vector<std::string> results;
             const std::string sep = "\3"; // 行内分隔符
             ns_util::StringUtil::CutString(line, &results, sep);
             if (results.size() != 3)
-                return nullptr;
-            // 2.填充DocInfo并插入到正排索引列表
-            DocInfo doc;
-            doc.title = results[0];
-            doc.content = results[1];
-            doc.url = results[2];
-            doc.doc_id = _forward_index.size();
-            _forward_index.push_back(std::move(doc));
-            return &_forward_index.back(); // 当前最后一个元素的地址
+                return false;
+            // 2.填充DocInfo并追加到正排索引里
+            doc->title = std::move(results[0]);
+            doc->content = std::move(results[1]);
+            doc->url = std::move(results[2]);
+            if (store)
+            {
+                _forward_index.Add(doc->title, doc->content, doc->url);
+            }
+            return true;
         }
 
-        // 注意：这里是某一个文档的的
-        bool BuildInvertedIndex(const DocInfo &doc)
+        // 前n篇文档的标题和内容交给JiebaUtil一次切完，再逐篇建倒排，返回建好的文档数。
+        // 正排索引已经存好了，doc的title和content在这里被原地转成小写
+        size_t BuildInvertedIndex(std::vector<DocInfo> *docs, size_t n)
         {
-            // DocInfo【title，content，url，doc_id】
-            // 分词
-            // 词频统计
-            struct word_cnt
+            // 分词：分出来的词是指向原文的视图，第i篇的标题是第2i段，内容是第2i+1段。
+            // 分词要看大小写（CamelCase），分完再把原文整个转成小写，视图就都是小写的了，不区分大小写
+            _texts.clear();
+            for (size_t i = 0; i < n; i++)
             {
-                int title_cnt;
-                int content_cnt;
-                word_cnt() : title_cnt(0), content_cnt(0) {}
-            };
-
-            // 关键字的词频映射
-            std::unordered_map<std::string, word_cnt> word_weight;
+                _texts.push_back(&(*docs)[i].title);
+                _texts.push_back(&(*docs)[i].content);
+            }
+            ns_util::JiebaUtil::CutStringsForSearch(_texts, &_batch);
 
-            // 标题的分词
-            std::vector<std::string> title_words;
-            ns_util::JiebaUtil::CutStringForSearch(doc.title, &title_words); // 标题分词
-            for (auto s : title_words)                                       // 这里不要引用，防止修改了原字符串
+            for (size_t i = 0; i < n; i++)
             {
-                boost::to_lower(s);         // 全部转成小写，不区分大小写
-                word_weight[s].title_cnt++; // 插入到映射表
+                DocInfo &doc = (*docs)[i];
+                // 词频统计
+                // 关键字的词频映射：按词条id直接下标访问_word_weight，_touched记录本文档出现过的词条
+                ns_util::StringUtil::ToLowerAscii(&doc.title);
+                for (const ns_util::StringView *w = _batch.Begin(2 * i); w != _batch.End(2 * i); ++w)
+                {
+                    CountWord(*w)->title_cnt++;
+                }
+                ns_util::StringUtil::ToLowerAscii(&doc.content);
+                for (const ns_util::StringView *w = _batch.Begin(2 * i + 1); w != _batch.End(2 * i + 1); ++w)
+                {
+                    CountWord(*w)->content_cnt++;
+                }
+
+                // 已经建立完映射表
+                // 现在建立倒排拉链
+                for (uint32_t word_id : _touched)
+                {
+                    word_cnt &cnt = _word_weight[word_id];
+                    InvertElem elem;
+                    elem.doc_id = doc.doc_id; // 当前文档的id
+                    elem.word_id = word_id;
+                    elem.weight = TITLE_WEIGHT * cnt.title_cnt + CONTENT_WEIGHT * cnt.content_cnt; // 相关性
+                    _inverted_index[word_id].emplace_back(std::move(elem)); // 找到倒排拉链，再在这个倒排拉链插入元素
+                    cnt = word_cnt();                                        // 清零，留给下一篇文档
+                }
+                _touched.clear();
             }
+            return n;
+        }
 
-            // 内容分词
-            std::vector<std::string> content_words;
-            ns_util::JiebaUtil::CutStringForSearch(doc.content, &content_words);
-            for (auto s : content_words) // 这里不要引用，防止修改了原字符串
+        // 相关性：词在标题里出现一次算10，在内容里出现一次算1
+        static const int TITLE_WEIGHT = 10;
+        static const int CONTENT_WEIGHT = 1;
+
+        struct word_cnt
+        {
+            int title_cnt;
+            int content_cnt;
+            word_cnt() : title_cnt(0), content_cnt(0) {}
+        };
+
+        // 驻留到词条字典（word已经是小写），返回该词条在当前文档里的计数
+        word_cnt *CountWord(const ns_util::StringView &word)
+        {
+            uint32_t word_id = _terms.Intern(word.data(), word.size());
+            if (word_id >= _inverted_index.size())
             {
-                boost::to_lower(s);
-                word_weight[s].content_cnt++;
+                _inverted_index.resize(word_id + 1);
+                _word_weight.resize(word_id + 1);
             }
-
-            // 已经建立完映射表
-            // 现在建立倒排拉链
-#define X 10
-#define Y 1
-            for (auto &word_pair : word_weight)
+            word_cnt *cnt = &_word_weight[word_id];
+            if (cnt->title_cnt == 0 && cnt->content_cnt == 0)
             {
-                InvertElem elem;
-                elem.doc_id = doc.doc_id; // 当前文档的id
-                elem.word = word_pair.first;
-                elem.weight = X * word_pair.second.title_cnt + Y * word_pair.second.content_cnt; // 相关性
-                InvertedList &inverted_list = _inverted_index[word_pair.first];                  // 找到倒排拉链，再在这个倒排拉链插入元素
-                inverted_list.emplace_back(std::move(elem));
+                _touched.push_back(word_id);
             }
-            return true;
+            return cnt;
         }
 
     private:
-        std::vector<DocInfo> _forward_index;                           // 正排索引
-        std::unordered_map<std::string, InvertedList> _inverted_index; // 倒排索引
+        ns_docstore::DocStore _forward_index;                          // 正排索引（块压缩，mmap）
+        ns_termdict::TermDict _terms;                                  // 建索引用的词条字典，词条id即_inverted_index下标
+        ns_termdict::SortedTermDict _sorted_terms;                     // 建完后冻结的有序词条字典，查询用
+        std::vector<InvertedList> _inverted_index;                     // 倒排索引
+
+        // 建索引时复用的临时空间
+        std::vector<word_cnt> _word_weight;
+        std::vector<uint32_t> _touched;
+        std::vector<const std::string *> _texts; // 一批文档要分词的标题和内容
+        ns_util::CutBatch _batch;                 // 这一批的分词结果，指向DocInfo里的原文
     };
 
     Index *Index::instance = nullptr;
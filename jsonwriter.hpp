@@ -0,0 +1,215 @@
+#pragma once
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include "util.hpp"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace ns_json
+{
+    // 流式json输出：直接往调用方的缓冲区里追加，不构建中间的树，
+    // 默认紧凑输出，pretty为true时带换行和缩进，方便调试
+    class JsonWriter
+    {
+    public:
+        explicit JsonWriter(std::string *out, bool pretty = false)
+            : _out(out), _pretty(pretty), _depth(0), _after_key(false)
+        {
+            _first[0] = true;
+        }
+
+        void StartObject() { Open('{'); }
+        void EndObject() { Close('}'); }
+        void StartArray() { Open('['); }
+        void EndArray() { Close(']'); }
+
+        void Key(const ns_util::StringView &key)
+        {
+            Separator();
+            AppendQuoted(key);
+            _out->append(_pretty ? " : " : ":");
+            _after_key = true;
+        }
+
+        void String(const ns_util::StringView &value)
+        {
+            Separator();
+            AppendQuoted(value);
+        }
+        void Int(int64_t value)
+        {
+            char buf[32];
+            int n = std::snprintf(buf, sizeof(buf), "%lld", (long long)value);
+            Separator();
+            _out->append(buf, n);
+        }
+        void UInt(uint64_t value)
+        {
+            char buf[32];
+            int n = std::snprintf(buf, sizeof(buf), "%llu", (unsigned long long)value);
+            Separator();
+            _out->append(buf, n);
+        }
+        void Bool(bool value)
+        {
+            Separator();
+            _out->append(value ? "true" : "false");
+        }
+        void Null()
+        {
+            Separator();
+            _out->append("null");
+        }
+
+        // 常用的"key": value组合
+        void Member(const char *key, const ns_util::StringView &value)
+        {
+            Key(key);
+            String(value);
+        }
+        void Member(const char *key, int64_t value)
+        {
+            Key(key);
+            Int(value);
+        }
+
+        // 把s转义后追加到out（不含两边的引号）
+        static void Escape(const ns_util::StringView &s, std::string *out)
+        {
+            const char *p = s.data();
+            const char *end = p + s.size();
+#ifdef __SSE2__
+            // 一次检查16字节：有没有 '"'、'\\' 或者 <0x20 的控制字符，都没有就整段拷贝
+            const __m128i quote = _mm_set1_epi8('"');
+            const __m128i slash = _mm_set1_epi8('\\');
+            const __m128i ctrl = _mm_set1_epi8(0x1f);
+            while (end - p >= 16)
+            {
+                __m128i x = _mm_loadu_si128((const __m128i *)p);
+                __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, quote), _mm_cmpeq_epi8(x, slash)),
+                                         _mm_cmpeq_epi8(_mm_max_epu8(x, ctrl), ctrl)); // x <= 0x1f（无符号）
+                int mask = _mm_movemask_epi8(m);
+                if (mask == 0)
+                {
+                    out->append(p, 16);
+                    p += 16;
+                    continue;
+                }
+                int skip = __builtin_ctz(mask);
+                out->append(p, skip);
+                p += skip;
+                EscapeChar(*p++, out);
+            }
+#endif
+            const char *run = p;
+            for (; p < end; p++)
+            {
+                unsigned char c = (unsigned char)*p;
+                if (c == '"' || c == '\\' || c < 0x20)
+                {
+                    out->append(run, p - run);
+                    EscapeChar(*p, out);
+                    run = p + 1;
+                }
+            }
+            out->append(run, p - run);
+        }
+
+    private:
+        static void EscapeChar(char c, std::string *out)
+        {
+            switch (c)
+            {
+            case '"':
+                out->append("\\\"");
+                break;
+            case '\\':
+                out->append("\\\\");
+                break;
+            case '\n':
+                out->append("\\n");
+                break;
+            case '\r':
+                out->append("\\r");
+                break;
+            case '\t':
+                out->append("\\t");
+                break;
+            case '\b':
+                out->append("\\b");
+                break;
+            case '\f':
+                out->append("\\f");
+                break;
+            default:
+            {
+                static const char hex[] = "0123456789abcdef";
+                char buf[6] = {'\\', 'u', '0', '0', hex[(c >> 4) & 0xf], hex[c & 0xf]};
+                out->append(buf, sizeof(buf));
+            }
+            }
+        }
+
+        void AppendQuoted(const ns_util::StringView &s)
+        {
+            _out->push_back('"');
+            Escape(s, _out);
+            _out->push_back('"');
+        }
+
+        // 值前面的逗号和换行缩进
+        void Separator()
+        {
+            if (_after_key)
+            {
+                _after_key = false;
+                return;
+            }
+            if (_depth == 0)
+                return;
+            if (!_first[_depth])
+                _out->push_back(',');
+            _first[_depth] = false;
+            NewLine();
+        }
+
+        void Open(char c)
+        {
+            Separator();
+            _out->push_back(c);
+            if (_depth + 1 < MAX_DEPTH)
+                ++_depth;
+            _first[_depth] = true;
+        }
+
+        void Close(char c)
+        {
+            bool empty = _first[_depth];
+            if (_depth > 0)
+                --_depth;
+            if (!empty)
+                NewLine();
+            _out->push_back(c);
+        }
+
+        void NewLine()
+        {
+            if (!_pretty)
+                return;
+            _out->push_back('\n');
+            _out->append(_depth * 3, ' ');
+        }
+
+    private:
+        static const int MAX_DEPTH = 32;
+        std::string *_out;
+        bool _pretty;
+        int _depth;
+        bool _after_key;       // 刚写完key，下一个值不需要分隔符
+        bool _first[MAX_DEPTH]; // 每一层是否还没有写过元素
+    };
+}
@@ -0,0 +1,296 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <ctime>
+#include <string>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <ostream>
+#include <streambuf>
+#include <sys/time.h>
+
+// 异步分级日志：
+//   LOG(INFO) << "建立索引成功";
+//   LOG_RATE(WARNING, 10) << word << " not find"; // 这一行每秒最多输出10条，多出来的只计数
+// 调用线程只把格式化好的消息拷进无锁环形缓冲区，由后台线程批量写出并flush，
+// 缓冲区满时丢弃消息并计数，不会阻塞查询线程
+namespace ns_log
+{
+    enum Level
+    {
+        DEBUG = 0,
+        INFO,
+        WARNING,
+        ERROR,
+    };
+
+    inline const char *LevelName(Level level)
+    {
+        static const char *names[] = {"DEBUG", "INFO", "WARNING", "ERROR"};
+        return names[level];
+    }
+
+    // 把日志写进固定大小的缓冲区，写满了就截断，不分配内存
+    class FixedBuf : public std::streambuf
+    {
+    public:
+        FixedBuf(char *buf, size_t size) { setp(buf, buf + size); }
+        size_t Size() const { return pptr() - pbase(); }
+    };
+
+    class Logger
+    {
+    public:
+        static const size_t SLOTS = 4096;   // 环形缓冲区的槽数，必须是2的幂
+        static const size_t MSG_SIZE = 480; // 一条消息最多的字节数，超出截断
+
+        static Logger *GetInstance()
+        {
+            static Logger instance; // 程序退出时析构，把剩下的日志写完
+            return &instance;
+        }
+
+        Level GetLevel() const { return (Level)_level.load(std::memory_order_relaxed); }
+        void SetLevel(Level level) { _level.store(level, std::memory_order_relaxed); }
+
+        // path为空表示写到标准错误
+        bool SetFile(const std::string &path)
+        {
+            FILE *fp = path.empty() ? stderr : std::fopen(path.c_str(), "a");
+            if (fp == nullptr)
+            {
+                std::fprintf(stderr, "open log file %s error: %s\n", path.c_str(), std::strerror(errno));
+                return false;
+            }
+            FILE *old = _out.exchange(fp);
+            if (old != stderr && old != nullptr)
+                _retired.store(old); // 写线程换完文件后关闭旧的
+            return true;
+        }
+
+        // 放进环形缓冲区（多生产者单消费者，按Vyukov的有界队列实现），满了返回false
+        bool Push(Level level, const char *file, int line, const char *msg, size_t len)
+        {
+            size_t pos = _head.load(std::memory_order_relaxed);
+            Slot *slot;
+            for (;;)
+            {
+                slot = &_slots[pos & (SLOTS - 1)];
+                size_t seq = slot->seq.load(std::memory_order_acquire);
+                intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+                if (diff == 0)
+                {
+                    if (_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (diff < 0)
+                {
+                    _dropped.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                else
+                {
+                    pos = _head.load(std::memory_order_relaxed);
+                }
+            }
+            slot->level = level;
+            slot->file = file;
+            slot->line = line;
+            gettimeofday(&slot->time, nullptr);
+            slot->len = len < MSG_SIZE ? len : MSG_SIZE;
+            std::memcpy(slot->msg, msg, slot->len);
+            slot->seq.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        // 等后台线程把已经提交的日志写完（测试、退出前用）
+        void Flush()
+        {
+            size_t target = _head.load(std::memory_order_acquire);
+            while (_tail.load(std::memory_order_acquire) < target)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+    private:
+        struct Slot
+        {
+            std::atomic<size_t> seq;
+            Level level;
+            const char *file;
+            int line;
+            struct timeval time;
+            size_t len;
+            char msg[MSG_SIZE];
+        };
+
+        Logger() : _level(INFO), _out(stderr), _retired(nullptr), _head(0), _tail(0), _dropped(0), _stop(false)
+        {
+            for (size_t i = 0; i < SLOTS; i++)
+                _slots[i].seq.store(i, std::memory_order_relaxed);
+            _writer = std::thread([this]
+                                  { Run(); });
+        }
+        ~Logger()
+        {
+            _stop = true;
+            _writer.join();
+            FILE *fp = _out.load();
+            if (fp != stderr)
+                std::fclose(fp);
+        }
+        Logger(const Logger &) = delete;
+        Logger &operator=(const Logger &) = delete;
+
+        // 后台线程：一次取出所有已提交的消息，格式化后写出，一批只flush一次
+        void Run()
+        {
+            char line[MSG_SIZE + 128];
+            time_t last_sec = 0;
+            char stamp[32] = {0};
+            for (;;)
+            {
+                FILE *fp = _out.load();
+                size_t n = 0;
+                size_t pos = _tail.load(std::memory_order_relaxed);
+                for (;;)
+                {
+                    Slot &slot = _slots[pos & (SLOTS - 1)];
+                    if (slot.seq.load(std::memory_order_acquire) != pos + 1)
+                        break;
+                    if (slot.time.tv_sec != last_sec)
+                    {
+                        struct tm tm;
+                        localtime_r(&slot.time.tv_sec, &tm);
+                        std::strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+                        last_sec = slot.time.tv_sec;
+                    }
+                    const char *base = std::strrchr(slot.file, '/');
+                    int len = std::snprintf(line, sizeof(line), "[%s.%03d][%s][%s:%d] ", stamp, (int)(slot.time.tv_usec / 1000),
+                                            LevelName(slot.level), base ? base + 1 : slot.file, slot.line);
+                    std::fwrite(line, 1, len, fp);
+                    std::fwrite(slot.msg, 1, slot.len, fp);
+                    std::fputc('\n', fp);
+                    slot.seq.store(pos + SLOTS, std::memory_order_release); // 槽位还给生产者
+                    ++pos;
+                    ++n;
+                    _tail.store(pos, std::memory_order_release);
+                }
+                size_t dropped = _dropped.exchange(0, std::memory_order_relaxed);
+                if (dropped > 0)
+                    std::fprintf(fp, "[log] ring buffer full, dropped %zu messages\n", dropped);
+                if (n > 0 || dropped > 0)
+                    std::fflush(fp);
+                FILE *retired = _retired.exchange(nullptr);
+                if (retired != nullptr)
+                    std::fclose(retired);
+                if (n == 0)
+                {
+                    if (_stop)
+                        return;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                }
+            }
+        }
+
+    private:
+        std::atomic<int> _level;
+        std::atomic<FILE *> _out;
+        std::atomic<FILE *> _retired; // 换下来等写线程关闭的文件
+        Slot _slots[SLOTS];
+        std::atomic<size_t> _head;    // 下一个要写入的位置
+        std::atomic<size_t> _tail;    // 下一个要写出的位置
+        std::atomic<size_t> _dropped; // 缓冲区满丢掉的条数
+        std::atomic<bool> _stop;
+        std::thread _writer;
+    };
+
+    // 一条日志：在栈上的缓冲区里格式化，析构时交给Logger
+    class LogMessage
+    {
+    public:
+        LogMessage(Level level, const char *file, int line, size_t suppressed = 0)
+            : _level(level), _file(file), _line(line), _buf(_data, sizeof(_data)), _stream(&_buf)
+        {
+            if (suppressed > 0)
+                _stream << "(" << suppressed << " similar messages suppressed) ";
+        }
+        ~LogMessage() { Logger::GetInstance()->Push(_level, _file, _line, _data, _buf.Size()); }
+        std::ostream &Stream() { return _stream; }
+
+    private:
+        Level _level;
+        const char *_file;
+        int _line;
+        char _data[Logger::MSG_SIZE];
+        FixedBuf _buf;
+        std::ostream _stream;
+    };
+
+    // 每个调用点一个：每秒最多放行per_sec条，被挡掉的条数附在下一条放行的日志里
+    class RateLimiter
+    {
+    public:
+        explicit RateLimiter(size_t per_sec) : _per_sec(per_sec), _second(0), _count(0), _suppressed(0) {}
+
+        // 放行时返回true，suppressed是上次放行以来被挡掉的条数
+        bool Allow(size_t *suppressed)
+        {
+            int64_t now = (int64_t)time(nullptr);
+            int64_t sec = _second.load(std::memory_order_relaxed);
+            if (now != sec && _second.compare_exchange_strong(sec, now, std::memory_order_relaxed))
+                _count.store(0, std::memory_order_relaxed);
+            if (_count.fetch_add(1, std::memory_order_relaxed) < _per_sec)
+            {
+                *suppressed = _suppressed.exchange(0, std::memory_order_relaxed);
+                return true;
+            }
+            _suppressed.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+    private:
+        size_t _per_sec;
+        std::atomic<int64_t> _second;
+        std::atomic<size_t> _count;
+        std::atomic<size_t> _suppressed;
+    };
+
+    inline bool Enabled(Level level) { return level >= Logger::GetInstance()->GetLevel(); }
+
+    // 把"if (...) ; else stream"里的ostream表达式吃掉，让宏可以安全地用在if/else里
+    struct Voidify
+    {
+        void operator&(std::ostream &) {}
+    };
+
+    inline bool ParseLevel(const std::string &name, Level *level)
+    {
+        static const char *names[] = {"debug", "info", "warning", "error"};
+        for (int i = 0; i <= ERROR; i++)
+        {
+            if (name == names[i])
+            {
+                *level = (Level)i;
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+#define LOG(level)                                 \
+    !ns_log::Enabled(ns_log::level) ? (void)0      \
+                                    : ns_log::Voidify() & ns_log::LogMessage(ns_log::level, __FILE__, __LINE__).Stream()
+
+// 限速版本：同一行每秒最多per_sec条。展开成两条语句，要单独成句使用（放在if里要加花括号）
+#define LOG_RATE(level, per_sec) LOG_RATE_IMPL(level, per_sec, __LINE__)
+#define LOG_RATE_IMPL(level, per_sec, line) LOG_RATE_IMPL2(level, per_sec, line)
+#define LOG_RATE_IMPL2(level, per_sec, line)                                                        \
+    static ns_log::RateLimiter _log_limiter_##line(per_sec);                                        \
+    size_t _log_suppressed_##line = 0;                                                              \
+    !ns_log::Enabled(ns_log::level) || !_log_limiter_##line.Allow(&_log_suppressed_##line) ? (void)0 \
+        : ns_log::Voidify() & ns_log::LogMessage(ns_log::level, __FILE__, __LINE__, _log_suppressed_##line).Stream()
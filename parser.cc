@@ -28,20 +28,20 @@ int main()
     // 第一步：递归式的把每个html文件名带路径，保存到files_list中，方便后期进行一个一个的文件读取
     if (!EnumFile(search_file, &files_list))
     {
-        std::cerr << "enum file name error!" << std::endl;
+        LOG(ERROR) << "enum file name error!";
         return 1;
     }
     std::vector<DocInfo_t> results;
     // 第二步：按照files_list读取每个文件的内容，并进行解析
     if (!ParseHtml(files_list, &results))
     {
-        std::cerr << "parse html error!" << std::endl;
+        LOG(ERROR) << "parse html error!";
         return 2;
     }
     // 第三步：把解析好的文件，写入到output，按照\3作为每个文件的分隔符
     if (!SaveHtml(results, output))
     {
-        std::cerr << "save html error!" << std::endl;
+        LOG(ERROR) << "save html error!";
         return 3;
     }
     return 0;
@@ -54,7 +54,7 @@ bool EnumFile(const std::string &search_file, std::vector<std::string> *files_li
     // 判断路径是否存在，不存在就直接退出
     if (!fs::exists(root_path))
     {
-        std::cerr << search_file << " not exists!" << std::endl;
+        LOG(ERROR) << search_file << " not exists!";
         return false;
     }
 
@@ -74,7 +74,7 @@ bool EnumFile(const std::string &search_file, std::vector<std::string> *files_li
         }
 
         // debug
-        // std::cout << "debug : " << iter->path().string() << std::endl;
+        // LOG(INFO) << "debug : " << iter->path().string();
 
         // 当前路径合法
         // 将所有带路径的html文件放到files_list容器
@@ -148,9 +148,9 @@ static bool ParseUrl(const std::string &file_path, std::string *url)
 
 void ShowDoc(const DocInfo_t &doc)
 {
-    std::cout << "Title: " << doc.title << std::endl;
-    std::cout << "Content: " << doc.content << std::endl;
-    std::cout << "Url: " << doc.url << std::endl;
+    LOG(DEBUG) << "Title: " << doc.title;
+    LOG(DEBUG) << "Content: " << doc.content;
+    LOG(DEBUG) << "Url: " << doc.url;
 }
 
 bool ParseHtml(const std::vector<std::string> &files_list, std::vector<DocInfo_t> *results)
@@ -196,7 +196,7 @@ bool SaveHtml(const std::vector<DocInfo_t> &results, const std::string &output)
     std::ofstream out(output, std::ios::out | std::ios::binary);
     if (!out.is_open())
     {
-        std::cerr << "open " << output << " error !" << std::endl;
+        LOG(ERROR) << "open " << output << " error !";
         return false;
     }
 
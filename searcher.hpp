@@ -1,8 +1,13 @@
 #pragma once
 
 #include <algorithm>
-#include <jsoncpp/json/json.h>
+#include <cstdio>
+#include <cstdlib>
 #include "index.hpp"
+#include "suggest.hpp"
+#include "snippet.hpp"
+#include "jsonwriter.hpp"
+#include "batch.hpp"
 
 namespace ns_searcher
 {
@@ -10,13 +15,23 @@ namespace ns_searcher
     {
         uint64_t doc_id;
         int weight;                     // 属于同一文档的weight
-        std::vector<std::string> words; // 属于同一文档的关键字
+        std::vector<uint32_t> word_ids; // 属于同一文档的关键字在查询分词结果里的下标，渲染时才换成词
         InvertedElemPrint() : doc_id(0), weight(0) {}
     };
 
+    // 分页参数：page从1开始；cursor非空时忽略page，从上一页的最后一条之后接着取
+    struct PageRequest
+    {
+        size_t page = 1;
+        size_t size = 10;
+        std::string cursor; // 上一次返回的next
+    };
+
     class Searcher
     {
     public:
+        static const size_t MAX_PAGE_SIZE = 50; // 每页最多返回的条数
+
         Searcher() {}
         ~Searcher() {}
 
@@ -26,119 +41,351 @@ namespace ns_searcher
         {
             // 1.获取Index对象
             _index = ns_index::Index::GetInstance();
-            std::cout << "获取index单例成功 ... " << std::endl;
+            LOG(INFO) << "获取index单例成功 ... ";
             // 2.根据Index对象建立索引
             _index->BulidIndex(input);
-            std::cout << "建立正排索引和倒排索引成功 ... " << std::endl;
+            LOG(INFO) << "建立正排索引和倒排索引成功 ... ";
+            // 3.根据词条字典建立前缀补全，按文档频率排序
+            _suggester.Build(_index->GetTermDict(), [this](uint32_t word_id)
+                             { return _index->GetInvertedList(word_id)->size(); });
+            LOG(INFO) << "建立前缀补全成功 ... ";
+        }
+
+        // prefix:用户已经输入的前缀
+        // out_json:返回的json串，按文档频率降序的补全词条
+        void Suggest(const std::string &prefix, size_t n, std::string *out_json)
+        {
+            std::string lower = prefix;
+            ns_util::StringUtil::ToLowerAscii(&lower);
+            std::vector<ns_suggest::Suggestion> suggestions;
+            _suggester.Suggest(lower, n, &suggestions);
+
+            out_json->clear();
+            ns_json::JsonWriter writer(out_json);
+            writer.StartArray();
+            for (auto &s : suggestions)
+            {
+                writer.StartObject();
+                writer.Member("word", s.word);
+                writer.Member("count", (int64_t)s.count);
+                writer.EndObject();
+            }
+            writer.EndArray();
         }
 
         // query:关键字查询
-        // out_json:返回的json串
-        void Search(const std::string &query, std::string *out_json)
-        {
-            // 1.分词：对query进行分词
-            std::vector<std::string> words;
-            ns_util::JiebaUtil::CutStringForSearch(query, &words);
-
-            // 空格得去掉
-            // std::cout << "debug" << std::endl;
-
-            // for (auto &e : words)
-            // {
-            //     std::cout << e << std::endl;
-            // }
-
-            // 2.触发：根据分词后的各个词，进行index查找
-            // ns_index::InvertedList inverted_list_all;                       // 存当前所有的关键字的拉链，拉链依次放在后面
-            std::vector<InvertedElemPrint> inverted_list_all;               // 存文档id去重之后要保存的节点
-            std::unordered_map<uint64_t, InvertedElemPrint> inverted_print; //  一个文档对应的关键字和权重
-            for (auto &word : words)
+        // req:要第几页、每页几条
+        // out_json:返回的json串，{"total":命中文档数, "page", "size", "next":下一页的cursor, "results":[...]}
+        // pretty:带换行缩进的json，调试时用
+        // 返回false表示cursor解不出来（被截断或者改过），这时不查询，out_json不动
+        bool Search(const std::string &query, const PageRequest &req, std::string *out_json, bool pretty = false)
+        {
+            // 当成第1页处理的话，跟着next翻页的客户端会一直转圈，所以直接拒绝
+            InvertedElemPrint after;
+            bool has_cursor = !req.cursor.empty();
+            if (has_cursor && !DecodeCursor(req.cursor, &after))
+                return false;
+
+            // 1.分词：对query进行分词，找出每个词的倒排拉链
+            SearchTask task;
+            Prepare(query, &task);
+
+            // 2.触发：扫描倒排拉链，按文档汇总权重。开了批处理时先和同一时间窗口里的其它查询
+            // 一起排好拉链的扫描顺序，汇总还是在本线程里做
+            if (_batcher)
+                _batcher->Submit(&task);
+            Accumulate(&task);
+
+            // 3.排序分页，4.构建json
+            Render(task, req, has_cursor ? &after : nullptr, out_json, pretty);
+            return true;
+        }
+
+        // 开启查询微批处理：先到的查询最多等window_us微秒（或者攒够max_batch个），
+        // 这一批查询按同一个顺序扫描拉链，用到同一条拉链的查询差不多同时扫它，
+        // 拉链从内存里读一遍之后其余的查询在缓存里命中。window_us为0表示关闭
+        void EnableBatching(size_t window_us, size_t max_batch)
+        {
+            if (window_us == 0)
+            {
+                _batcher.reset();
+                return;
+            }
+            _batcher.reset(new ns_batch::MicroBatcher<SearchTask>([this](std::vector<SearchTask *> &tasks)
+                                                                  { Group(tasks); },
+                                                                  window_us, max_batch));
+        }
+
+        // 管理操作：按现在的词典文件（主要是改过的用户词典）新建分词器，原子地换掉查询用的那个，不用重启。
+        // 倒排索引是用旧词典切的，不会重建。换之前用新旧两个分词器各切一遍已索引的非ASCII词条
+        // （ASCII的词由CodeTokenizer切，和词典无关），切得不一样的列在out_json里：
+        // {"ok", "checked":比较过的词条数, "changed":切得不一样的个数, "terms":[{"term", "before", "after"}, ...]}，
+        // terms最多列MAX_RELOAD_REPORT个。这些词在重建索引之前可能搜不到。加载失败时不换，返回false
+        bool ReloadUserDict(std::string *out_json)
+        {
+            std::lock_guard<std::mutex> lock(_reload_mtx); // 同时只做一次
+            out_json->clear();
+            ns_json::JsonWriter writer(out_json);
+            writer.StartObject();
+            ns_util::JiebaUtil::JiebaPtr fresh = ns_util::JiebaUtil::LoadJieba();
+            if (!fresh)
+            {
+                writer.Key("ok");
+                writer.Bool(false);
+                writer.Member("error", "加载词典失败");
+                writer.EndObject();
+                return false;
+            }
+            ns_util::JiebaUtil::JiebaPtr current = ns_util::JiebaUtil::CurrentJieba();
+
+            size_t checked = 0, changed = 0;
+            std::string term;
+            std::vector<std::string> before, after;
+            writer.Key("ok");
+            writer.Bool(true);
+            writer.Key("terms");
+            writer.StartArray();
+            // 词条按字节序排列，非ASCII的词条都在"\x80"之后
+            for (auto iter = _index->GetTermDict().LowerBound("\x80"); iter.Valid(); iter.Next())
+            {
+                term = iter.Term().ToString();
+                ns_util::JiebaUtil::CutStringForSearch(*current, term, &before);
+                ns_util::JiebaUtil::CutStringForSearch(*fresh, term, &after);
+                ++checked;
+                if (before == after)
+                    continue;
+                if (++changed > MAX_RELOAD_REPORT)
+                    continue;
+                writer.StartObject();
+                writer.Member("term", term);
+                WriteWords(writer, "before", before);
+                WriteWords(writer, "after", after);
+                writer.EndObject();
+            }
+            writer.EndArray();
+            writer.Member("checked", (int64_t)checked);
+            writer.Member("changed", (int64_t)changed);
+            writer.EndObject();
+
+            ns_util::JiebaUtil::ReplaceJieba(fresh);
+            LOG(INFO) << "重新加载词典，" << checked << " 个已索引词条里 " << changed << " 个分词结果变了";
+            return true;
+        }
+
+    private:
+        static const size_t MAX_RELOAD_REPORT = 1000;
+
+        static void WriteWords(ns_json::JsonWriter &writer, const char *key, const std::vector<std::string> &words)
+        {
+            writer.Key(key);
+            writer.StartArray();
+            for (auto &w : words)
+                writer.String(w);
+            writer.EndArray();
+        }
+
+        // 一次查询在各个阶段之间传递的数据
+        struct SearchTask
+        {
+            std::vector<std::string> words;                  // 分词后转小写的关键字
+            std::vector<ns_index::InvertedList *> lists;     // 和words一一对应，找不到的词是nullptr
+            std::vector<uint32_t> order;                     // 要扫描的词的下标，按扫描顺序；空表示按words的顺序
+            std::unordered_map<uint64_t, InvertedElemPrint> hits; // 一个文档对应的关键字和权重
+        };
+
+        void Prepare(const std::string &query, SearchTask *task)
+        {
+            ns_util::JiebaUtil::CutStringForSearch(query, &task->words);
+            task->lists.reserve(task->words.size());
+            for (auto &word : task->words)
             {
                 // 查找倒排拉链
                 boost::to_lower(word);
-                ns_index::InvertedList *inverted_list = _index->GetInvertedIndex(word); // 存的InvertElem
-                if (nullptr == inverted_list)
+                task->lists.push_back(_index->GetInvertedIndex(word)); // 存的InvertElem
+            }
+        }
+
+        // 批处理线程上只做这一步：给这一批用到的拉链按第一次出现的顺序编号，
+        // 每个查询按这个编号排好自己的扫描顺序。只看拉链指针，不碰拉链内容，
+        // 真正的扫描和汇总回到各个查询自己的线程上并行做
+        static void Group(std::vector<SearchTask *> &tasks)
+        {
+            std::unordered_map<ns_index::InvertedList *, size_t> rank;
+            for (SearchTask *task : tasks)
+            {
+                for (ns_index::InvertedList *list : task->lists)
                 {
-                    continue;
+                    if (list != nullptr)
+                        rank.insert(std::make_pair(list, rank.size()));
+                }
+            }
+            for (SearchTask *task : tasks)
+            {
+                task->order.clear();
+                for (size_t i = 0; i < task->lists.size(); i++)
+                {
+                    if (task->lists[i] != nullptr)
+                        task->order.push_back((uint32_t)i);
                 }
-                // 找到了倒排拉链
-                // 不完美！可能存在关键字在同一文档出现，导致显示多个html
-                // inverted_list_all.insert(inverted_list_all.end(), inverted_list->begin(), inverted_list->end()); // 存的InvertElem
+                std::stable_sort(task->order.begin(), task->order.end(), [&rank, task](uint32_t a, uint32_t b)
+                                 { return rank[task->lists[a]] < rank[task->lists[b]]; });
+            }
+        }
 
-                for (auto &elem : *inverted_list)
+        // 把一个查询的拉链按文档汇总到hits里，一个查询里重复的词各算一次权重
+        void Accumulate(SearchTask *task)
+        {
+            size_t n = task->order.empty() ? task->lists.size() : task->order.size();
+            for (size_t k = 0; k < n; k++)
+            {
+                uint32_t i = task->order.empty() ? (uint32_t)k : task->order[k];
+                ns_index::InvertedList *list = task->lists[i];
+                if (nullptr == list)
+                {
+                    continue;
+                }
+                for (auto &elem : *list)
                 {
-                    // 把关键字对应的文档放到inverted_print
-                    InvertedElemPrint &item = inverted_print[elem.doc_id];
+                    // 把关键字对应的文档放到hits
+                    InvertedElemPrint &item = task->hits[elem.doc_id];
                     // 这里之后，item一定是doc_id相同的节点
                     item.doc_id = elem.doc_id;
                     item.weight += elem.weight; // 同一个doc_id的关键字就权值相加
-                    item.words.push_back(elem.word);
+                    item.word_ids.push_back(i); // 就是elem.word_id对应的关键字，只记下标，不拷贝字符串
                 }
             }
+        }
 
-            // 把inverted_print的InvertedElemPrint放到inverted_list_all里面
+        // after:已经解好的cursor，nullptr表示按page翻页
+        void Render(SearchTask &task, const PageRequest &req, const InvertedElemPrint *after, std::string *out_json, bool pretty)
+        {
+            std::vector<InvertedElemPrint> inverted_list_all; // 存文档id去重之后要保存的节点
+            std::unordered_map<uint64_t, InvertedElemPrint> &inverted_print = task.hits;
+
+            // 把inverted_print的InvertedElemPrint放到inverted_list_all里面，
+            // 带cursor时只保留排在cursor后面的文档
+            size_t total = inverted_print.size();
+            bool has_cursor = after != nullptr;
             for (auto &item : inverted_print)
             {
+                if (has_cursor && !Before(*after, item.second))
+                    continue;
                 inverted_list_all.push_back(std::move(item.second));
             }
 
-            // 3.合并排序：汇总查找结果，按照相关性（weight）进行降序排序
-            // sort(inverted_list_all.begin(), inverted_list_all.end(), [](const ns_index::InvertElem &e1, const ns_index::InvertElem &e2)
-            //      { return e1.weight > e2.weight; });
+            // 3.合并排序：按照相关性（weight）降序，weight相同按doc_id升序，保证翻页时顺序稳定。
+            // 只把要返回的前offset+size个排好，其余的不排
+            size_t size = req.size == 0 ? 1 : (req.size < MAX_PAGE_SIZE ? req.size : MAX_PAGE_SIZE);
+            size_t page = req.page == 0 ? 1 : req.page;
+            size_t offset = 0;
+            if (!has_cursor)
+                offset = page - 1 < inverted_list_all.size() ? (page - 1) * size : inverted_list_all.size();
+            size_t begin = std::min(offset, inverted_list_all.size());
+            size_t end = std::min(offset + size, inverted_list_all.size());
+            std::partial_sort(inverted_list_all.begin(), inverted_list_all.begin() + end, inverted_list_all.end(), Before);
 
-            sort(inverted_list_all.begin(), inverted_list_all.end(), [](const InvertedElemPrint &e1, const InvertedElemPrint &e2)
-                 { return e1.weight > e2.weight; });
-
-            // 4.构建：根据查找出来的结果，构建json串 -- jsoncpp
-            Json::Value root;
-            for (auto &elem : inverted_list_all) // 已经有序
+            // 4.构建：只为这一页的文档取正文、生成摘要，直接把json写进out_json
+            out_json->clear();
+            ns_json::JsonWriter writer(out_json, pretty);
+            writer.StartObject();
+            writer.Member("total", (int64_t)total);
+            writer.Member("page", (int64_t)(has_cursor ? 0 : page)); // 按cursor翻页时没有页码
+            writer.Member("size", (int64_t)size);
+            writer.Key("next");
+            if (end < inverted_list_all.size())
+            {
+                std::string next;
+                EncodeCursor(inverted_list_all[end - 1], &next);
+                writer.String(next);
+            }
+            else
+            {
+                writer.Null();
+            }
+            writer.Key("results");
+            writer.StartArray();
+            ns_docstore::DocView doc;
+            std::vector<std::string> words; // 这篇文档命中的关键字
+            std::string buffer;             // 高亮标题和摘要共用的输出缓冲区
+            for (size_t i = begin; i < end; i++) // 已经有序
             {
-                // 获取正排索引的文档id
-                ns_index::DocInfo *doc = _index->GetForwardIndex(elem.doc_id);
-                Json::Value value;
-                value["title"] = doc->title;
-                value["desc"] = GetDesc(doc->content, elem.words[0]); // GetDesc(doc->content, elem.word); // 只获取摘要
-                value["url"] = doc->url;
+                InvertedElemPrint &elem = inverted_list_all[i];
+                // 获取正排索引的文档视图
+                if (!_index->GetForwardIndex(elem.doc_id, &doc))
+                {
+                    continue;
+                }
+                writer.StartObject();
+                writer.Member("title", doc.title);
+                words.clear();
+                for (uint32_t id : elem.word_ids)
+                    words.push_back(task.words[id]);
+                UniqueWords(&words);
+                buffer.clear();
+                GetSnippetBuilder().Highlight(doc.title, words, &buffer); // 标题里命中的词加<em>
+                writer.Member("title_hl", buffer);
+                buffer.clear();
+                GetDesc(doc.content, words, &buffer); // 只获取摘要，命中的词加<em>
+                writer.Member("desc", buffer);
+                writer.Member("url", doc.url);
 
                 // for debug ,for delete
-                value["doc_id"] = (int)elem.doc_id;
-                value["weight"] = elem.weight;
-
-                root.append(value);
+                writer.Member("doc_id", (int64_t)elem.doc_id);
+                writer.Member("weight", (int64_t)elem.weight);
+                writer.EndObject();
             }
-            Json::StyledWriter writer;
-            *out_json = writer.write(root);
+            writer.EndArray();
+            writer.EndObject();
         }
 
-        std::string GetDesc(const std::string &content, const std::string &word)
+    public:
+        // 摘要：选正文里包含查询词最多的一段，两端对齐到UTF-8字符/单词边界，命中的词用<em>标出
+        // words是这篇文档命中的（小写、去重）关键字，摘要追加到out后面
+        void GetDesc(const ns_util::StringView &content, const std::vector<std::string> &words, std::string *out)
         {
-            // 找到关键字的左边50字节，右边100字节
-            const int prev_len = 50;
-            const int next_len = 100;
-            // 这里注意，content里面的内容是没有进行转小写的，而word是小写的，因此我们需要对content特殊处理来查找word
-            auto iter = std::search(content.begin(), content.end(), word.begin(), word.end(), [](const char c1, const char c2)
-                                    { return std::tolower(c1) == std::tolower(c2); });
-            if (iter == content.end())
-            {
-                return "None1";
-            }
-            int pos = std::distance(content.begin(), iter);
-            int start = 0;                // 如果当前关键字前面没有50字节，就用这个作为起始点
-            int end = content.size() - 1; // 如果当前关键字后面没有100字节，就用这个作为结束点
+            GetSnippetBuilder().Build(content, words, out);
+        }
+
+    private:
+        // http服务器多线程调用Search，每个线程各用一份临时空间
+        static ns_snippet::SnippetBuilder &GetSnippetBuilder()
+        {
+            static thread_local ns_snippet::SnippetBuilder builder;
+            return builder;
+        }
 
-            if (pos > start + prev_len)
-                start = pos - prev_len;
-            if (pos < end - next_len)
-                end = pos + next_len;
+        // 结果的排序：weight降序，相同时doc_id升序
+        static bool Before(const InvertedElemPrint &e1, const InvertedElemPrint &e2)
+        {
+            return e1.weight > e2.weight || (e1.weight == e2.weight && e1.doc_id < e2.doc_id);
+        }
 
-            // 获取子串
-            if (end <= start)
-                return "None2";
-            std::string ret = content.substr(start, end - start) + " ... ";
-            return ret;
+        // cursor记录上一页最后一条的(weight, doc_id)，编码成24个十六进制字符，对调用方不透明
+        static void EncodeCursor(const InvertedElemPrint &last, std::string *out)
+        {
+            char buf[32];
+            std::snprintf(buf, sizeof(buf), "%08x%016llx", (unsigned)last.weight, (unsigned long long)last.doc_id);
+            out->assign(buf, 24);
         }
 
-    private:
-        ns_index::Index *_index; // 供系统进行查找的索引
+        static bool DecodeCursor(const std::string &cursor, InvertedElemPrint *last)
+        {
+            if (cursor.size() != 24 || cursor.find_first_not_of("0123456789abcdef") != std::string::npos)
+                return false;
+            last->weight = (int)std::strtoul(cursor.substr(0, 8).c_str(), nullptr, 16);
+            last->doc_id = std::strtoull(cursor.substr(8).c_str(), nullptr, 16);
+            return true;
+        }
+
+        static void UniqueWords(std::vector<std::string> *words)
+        {
+            std::sort(words->begin(), words->end());
+            words->erase(std::unique(words->begin(), words->end()), words->end());
+        }
+
+        ns_index::Index *_index;         // 供系统进行查找的索引
+        ns_suggest::Suggester _suggester; // 前缀补全
+        std::unique_ptr<ns_batch::MicroBatcher<SearchTask>> _batcher; // 查询微批处理，没开启时为空
+        std::mutex _reload_mtx;           // ReloadUserDict同时只做一次
     };
 }
\ No newline at end of file
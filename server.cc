@@ -16,7 +16,7 @@ int main()
     {
         std::cout << "please enter searcher words # ";
         std::cin >> query;
-        searcher->Search(query, &out_json);
+        searcher->Search(query, ns_searcher::PageRequest(), &out_json, true); // 终端里看，带缩进输出
 
         std::cout << out_json << std::endl;
     }
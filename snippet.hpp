@@ -0,0 +1,305 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include "util.hpp"
+
+namespace ns_snippet
+{
+    // 摘要生成：在正文里找出所有查询词的出现位置（忽略ASCII大小写），
+    // 选出覆盖查询词种类最多的窗口，再把窗口两端对齐到UTF-8字符/单词边界。
+    // 正文是去标签后的html文本（仍带&amp;这类实体），输出时把命中的词用<em></em>包起来，
+    // 边扫描边写进调用方的缓冲区，不为每个命中单独生成字符串
+    class SnippetBuilder
+    {
+    public:
+        static const size_t PREV_LEN = 50;       // 第一个命中词左边保留的字节数
+        static const size_t NEXT_LEN = 100;      // 第一个命中词右边保留的字节数
+        static const size_t MAX_HITS_PER_TERM = 256; // 每个词最多记录的命中数
+        static const size_t SNAP_LEN = 12;       // 对齐到空白时最多挪动的字节数
+
+        struct Hit
+        {
+            uint32_t pos;  // 命中位置
+            uint32_t len;  // 命中长度
+            uint32_t term; // 第几个查询词
+        };
+
+        // terms需要是小写的查询词，摘要追加到out后面，highlight为true时给命中的词加<em>
+        void Build(const ns_util::StringView &content, const std::vector<std::string> &terms, std::string *out, bool highlight = true)
+        {
+            FindHits(content, terms);
+            size_t begin = 0, end = content.size();
+            if (_hits.empty())
+            {
+                // 正文里没有命中（比如只命中了标题），取正文开头
+                end = std::min(content.size(), PREV_LEN + NEXT_LEN);
+            }
+            else
+            {
+                size_t first = 0;
+                BestWindow(terms.size(), &first, &_last);
+                size_t pos = _hits[first].pos;
+                begin = pos > PREV_LEN ? pos - PREV_LEN : 0;
+                end = std::max<size_t>(pos + NEXT_LEN, _hits[_last].pos + _hits[_last].len);
+                end = std::min(end, content.size());
+            }
+            size_t min_end = begin;
+            if (!_hits.empty())
+                min_end = _hits[_last].pos + _hits[_last].len;
+            SnapBegin(content, &begin);
+            SnapEnd(content, std::max(begin, min_end), &end);
+            if (highlight)
+                AppendHighlighted(content, begin, end, out);
+            else
+                out->append(content.data() + begin, end - begin);
+            out->append(" ... ");
+        }
+
+        // 整段文本（比如标题）高亮后追加到out
+        void Highlight(const ns_util::StringView &text, const std::vector<std::string> &terms, std::string *out)
+        {
+            FindHits(text, terms);
+            AppendHighlighted(text, 0, text.size(), out);
+        }
+
+        // 上一次Build找到的命中，按位置排序
+        const std::vector<Hit> &Hits() const { return _hits; }
+
+        // 不区分ASCII大小写的子串查找：用memchr分别找首字节的大写和小写形式
+        // （glibc的memchr是向量化的），找到候选后再逐字节比较剩余部分
+        static size_t FindNoCase(const ns_util::StringView &text, size_t from, const std::string &word)
+        {
+            if (word.empty() || word.size() > text.size())
+                return std::string::npos;
+            const char *base = text.data();
+            const char *last = base + text.size() - word.size() + 1; // 候选首字节的上界
+            char lo = ToLower(word[0]);
+            char up = ToUpper(word[0]);
+            const char *p = base + from;
+            // next_lo/next_up是两种形式的下一个出现位置，last表示后面再也没有，nullptr表示需要重新找
+            const char *next_lo = nullptr, *next_up = nullptr;
+            while (p < last)
+            {
+                if (next_lo == nullptr)
+                {
+                    next_lo = (const char *)std::memchr(p, lo, last - p);
+                    if (next_lo == nullptr)
+                        next_lo = last;
+                }
+                if (lo == up)
+                    next_up = next_lo;
+                else if (next_up == nullptr)
+                {
+                    next_up = (const char *)std::memchr(p, up, last - p);
+                    if (next_up == nullptr)
+                        next_up = last;
+                }
+                const char *cand = std::min(next_lo, next_up);
+                if (cand == last)
+                    break;
+                if (EqualNoCase(cand + 1, word.data() + 1, word.size() - 1))
+                    return cand - base;
+                p = cand + 1;
+                if (next_lo == cand)
+                    next_lo = nullptr;
+                if (next_up == cand)
+                    next_up = nullptr;
+            }
+            return std::string::npos;
+        }
+
+    private:
+        static char ToLower(char c) { return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c; }
+        static char ToUpper(char c) { return (c >= 'a' && c <= 'z') ? c - ('a' - 'A') : c; }
+        static bool EqualNoCase(const char *a, const char *lower, size_t n)
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                if (ToLower(a[i]) != lower[i])
+                    return false;
+            }
+            return true;
+        }
+        static bool IsContinuation(char c) { return ((unsigned char)c & 0xC0) == 0x80; }
+        static bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+        void FindHits(const ns_util::StringView &content, const std::vector<std::string> &terms)
+        {
+            _hits.clear();
+            for (size_t t = 0; t < terms.size(); t++)
+            {
+                size_t from = 0, n = 0;
+                size_t pos;
+                while (n < MAX_HITS_PER_TERM && (pos = FindNoCase(content, from, terms[t])) != std::string::npos)
+                {
+                    from = pos + terms[t].size();
+                    if (InsideEntity(content, pos))
+                        continue; // &amp;里的amp不算命中
+                    Hit hit;
+                    hit.pos = (uint32_t)pos;
+                    hit.len = (uint32_t)terms[t].size();
+                    hit.term = (uint32_t)t;
+                    _hits.push_back(hit);
+                    ++n;
+                }
+            }
+            std::sort(_hits.begin(), _hits.end(), [](const Hit &a, const Hit &b)
+                      { return a.pos < b.pos || (a.pos == b.pos && a.len > b.len); });
+        }
+
+        // 双指针滑动窗口：窗口跨度不超过PREV_LEN+NEXT_LEN，优先覆盖的查询词种类多，其次命中次数多
+        void BestWindow(size_t term_count, size_t *first, size_t *last)
+        {
+            _term_cnt.assign(term_count, 0);
+            size_t distinct = 0, best_distinct = 0, best_hits = 0;
+            size_t left = 0;
+            for (size_t right = 0; right < _hits.size(); right++)
+            {
+                if (_term_cnt[_hits[right].term]++ == 0)
+                    ++distinct;
+                while (_hits[right].pos + _hits[right].len - _hits[left].pos > PREV_LEN + NEXT_LEN)
+                {
+                    if (--_term_cnt[_hits[left].term] == 0)
+                        --distinct;
+                    ++left;
+                }
+                size_t count = right - left + 1;
+                if (distinct > best_distinct || (distinct == best_distinct && count > best_hits))
+                {
+                    best_distinct = distinct;
+                    best_hits = count;
+                    *first = left;
+                    *last = right;
+                }
+            }
+        }
+
+        // pos是否落在&xxx;这样的html实体里面（实体最长按10字节算）
+        static bool InsideEntity(const ns_util::StringView &text, size_t pos)
+        {
+            size_t amp = pos;
+            for (size_t i = 0; i < 10 && amp > 0; i++)
+            {
+                --amp;
+                char c = text[amp];
+                if (c == '&')
+                    break;
+                if (c == ';' || IsSpace(c))
+                    return false;
+            }
+            if (text[amp] != '&' || amp == pos)
+                return false;
+            for (size_t i = pos; i < text.size() && i < amp + 10; i++)
+            {
+                char c = text[i];
+                if (c == ';')
+                    return true;
+                if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '#'))
+                    return false;
+            }
+            return false;
+        }
+
+        // 按位置有序的_hits把[begin, end)写到out，重叠或相邻的命中合并成一个<em>
+        void AppendHighlighted(const ns_util::StringView &text, size_t begin, size_t end, std::string *out) const
+        {
+            out->reserve(out->size() + (end - begin) + 16);
+            size_t cur = begin;
+            size_t hs = 0, he = 0; // 当前待输出的高亮区间
+            bool open = false;
+            for (const Hit &hit : _hits)
+            {
+                if (hit.pos < cur || hit.pos + hit.len > end)
+                    continue;
+                if (open && hit.pos <= he)
+                {
+                    he = std::max<size_t>(he, hit.pos + hit.len);
+                    continue;
+                }
+                if (open)
+                {
+                    AppendMarked(text, cur, hs, he, out);
+                    cur = he;
+                }
+                hs = hit.pos;
+                he = hit.pos + hit.len;
+                open = true;
+            }
+            if (open)
+            {
+                AppendMarked(text, cur, hs, he, out);
+                cur = he;
+            }
+            out->append(text.data() + cur, end - cur);
+        }
+
+        static void AppendMarked(const ns_util::StringView &text, size_t cur, size_t hs, size_t he, std::string *out)
+        {
+            out->append(text.data() + cur, hs - cur);
+            out->append("<em>");
+            out->append(text.data() + hs, he - hs);
+            out->append("</em>");
+        }
+
+        // 起点不能落在多字节字符或html实体中间，附近有空白就从空白后开始
+        static void SnapBegin(const ns_util::StringView &content, size_t *begin)
+        {
+            size_t b = *begin;
+            if (b == 0)
+                return;
+            while (b < content.size() && IsContinuation(content[b]))
+                ++b;
+            if (b < content.size() && InsideEntity(content, b))
+            {
+                while (b < content.size() && content[b] != ';')
+                    ++b;
+                ++b;
+            }
+            for (size_t i = b; i < content.size() && i < b + SNAP_LEN; i++)
+            {
+                if (IsSpace(content[i - 1]) && !IsSpace(content[i]))
+                {
+                    b = i;
+                    break;
+                }
+            }
+            *begin = b;
+        }
+
+        // 终点同样对齐到字符开头，附近有空白就在空白处结束，但不早于min_end
+        static void SnapEnd(const ns_util::StringView &content, size_t min_end, size_t *end)
+        {
+            size_t e = *end;
+            if (e >= content.size())
+            {
+                *end = content.size();
+                return;
+            }
+            while (e > min_end && IsContinuation(content[e]))
+                --e;
+            if (e > min_end && InsideEntity(content, e))
+            {
+                while (e > min_end && content[e] != '&')
+                    --e;
+            }
+            for (size_t i = e; i > min_end && i + SNAP_LEN > e; i--)
+            {
+                if (IsSpace(content[i]))
+                {
+                    e = i;
+                    break;
+                }
+            }
+            *end = e;
+        }
+
+    private:
+        std::vector<Hit> _hits;
+        std::vector<uint32_t> _term_cnt;
+        size_t _last = 0; // 最佳窗口里最后一个命中
+    };
+}
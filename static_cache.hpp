@@ -0,0 +1,292 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <map>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <cstdio>
+#include <cstdint>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <boost/filesystem.hpp>
+#include "compress.hpp"
+
+namespace ns_static
+{
+    // 一个静态文件。小文件连同gzip/br压缩版本都放在内存里；大文件只记元信息，发送时用sendfile
+    struct StaticFile
+    {
+        std::string fs_path;       // 磁盘上的路径
+        std::string content_type;
+        std::string etag;          // 强ETag（带引号），压缩版本在引号里加-gz/-br后缀
+        std::string cache_control;
+        size_t size = 0;           // 原文字节数
+        bool in_memory = false;
+        std::string plain;
+        std::string gzip; // 不值得压缩时为空
+        std::string br;
+
+        // 客户端接受e时实际发送的编码
+        ns_compress::Encoding Choose(ns_compress::Encoding e) const
+        {
+            if (e == ns_compress::ENCODING_BR && !br.empty())
+                return e;
+            if (e == ns_compress::ENCODING_GZIP && !gzip.empty())
+                return e;
+            return ns_compress::ENCODING_NONE;
+        }
+        const std::string &Body(ns_compress::Encoding e) const
+        {
+            if (e == ns_compress::ENCODING_BR)
+                return br;
+            if (e == ns_compress::ENCODING_GZIP)
+                return gzip;
+            return plain;
+        }
+        std::string ETag(ns_compress::Encoding e) const
+        {
+            if (e == ns_compress::ENCODING_NONE)
+                return etag;
+            return etag.substr(0, etag.size() - 1) + (e == ns_compress::ENCODING_BR ? "-br\"" : "-gz\"");
+        }
+        // If-None-Match里有这个文件任一编码的ETag都算命中（内容相同）
+        bool Matches(const std::string &if_none_match) const
+        {
+            if (if_none_match.empty())
+                return false;
+            if (if_none_match == "*")
+                return true;
+            std::string base = etag.substr(0, etag.size() - 1); // 去掉结尾的引号
+            size_t pos = 0;
+            while ((pos = if_none_match.find(base, pos)) != std::string::npos)
+            {
+                size_t end = pos + base.size();
+                if (end < if_none_match.size() && (if_none_match[end] == '"' || if_none_match[end] == '-'))
+                    return true;
+                pos = end;
+            }
+            return false;
+        }
+    };
+
+    // 启动时把静态文件目录整个读进内存，inotify监视目录，有变化就重新加载并整体替换，
+    // 请求线程拿到的是加载时的快照，不会读到一半的文件
+    class StaticCache
+    {
+    public:
+        typedef std::map<std::string, std::shared_ptr<const StaticFile>> FileMap; // url路径 -> 文件
+
+        StaticCache(const std::string &root, size_t max_age, size_t memory_limit)
+            : _root(root), _max_age(max_age), _memory_limit(memory_limit), _inotify_fd(-1), _stop(false)
+        {
+        }
+        ~StaticCache()
+        {
+            _stop = true;
+            if (_watcher.joinable())
+                _watcher.join();
+            if (_inotify_fd >= 0)
+                close(_inotify_fd);
+        }
+
+        // 加载目录，watch为true时起一个线程监视目录变化
+        bool Init(bool watch)
+        {
+            if (!Reload())
+                return false;
+            if (!watch)
+                return true;
+            _inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (_inotify_fd < 0)
+            {
+                LOG(ERROR) << "inotify_init1 error, " << _root << " will not be reloaded";
+                return true;
+            }
+            AddWatches();
+            _watcher = std::thread([this]
+                                   { Watch(); });
+            return true;
+        }
+
+        // path是请求的url路径，以/结尾的取目录下的index.html
+        std::shared_ptr<const StaticFile> Find(const std::string &path) const
+        {
+            std::shared_ptr<const FileMap> files = std::atomic_load(&_files);
+            if (!files)
+                return nullptr;
+            auto it = files->find(!path.empty() && path.back() == '/' ? path + "index.html" : path);
+            return it == files->end() ? nullptr : it->second;
+        }
+
+        bool Reload()
+        {
+            namespace fs = boost::filesystem;
+            boost::system::error_code ec;
+            fs::path root(_root);
+            if (!fs::is_directory(root, ec))
+            {
+                LOG(ERROR) << _root << " is not a directory";
+                return false;
+            }
+            std::shared_ptr<FileMap> files(new FileMap());
+            size_t bytes = 0;
+            fs::recursive_directory_iterator end;
+            for (fs::recursive_directory_iterator iter(root, ec); !ec && iter != end; iter.increment(ec))
+            {
+                if (!fs::is_regular_file(iter->status()))
+                    continue;
+                std::string fs_path = iter->path().string();
+                std::string url = fs_path.substr(root.string().size());
+                if (url.empty() || url[0] != '/')
+                    url = "/" + url;
+                std::shared_ptr<StaticFile> file(new StaticFile());
+                if (!LoadFile(fs_path, file.get()))
+                    continue;
+                bytes += file->plain.size() + file->gzip.size() + file->br.size();
+                (*files)[url] = file;
+            }
+            std::atomic_store(&_files, std::shared_ptr<const FileMap>(files));
+            LOG(INFO) << "加载静态文件 " << files->size() << " 个，占内存 " << bytes << " 字节";
+            return true;
+        }
+
+    private:
+        bool LoadFile(const std::string &fs_path, StaticFile *file) const
+        {
+            struct stat st;
+            if (stat(fs_path.c_str(), &st) != 0)
+                return false;
+            file->fs_path = fs_path;
+            file->size = st.st_size;
+            file->content_type = ContentType(fs_path);
+            bool html = file->content_type.compare(0, 9, "text/html") == 0;
+            // html每次都回源校验（304很便宜），其它资源在max_age内直接用本地缓存
+            file->cache_control = html ? "no-cache" : "public, max-age=" + std::to_string(_max_age);
+            char tag[64];
+            if (file->size > _memory_limit)
+            {
+                // 大文件不进内存，ETag用大小和修改时间
+                std::snprintf(tag, sizeof(tag), "\"%zx-%llx\"", file->size,
+                              (unsigned long long)st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec);
+                file->etag = tag;
+                file->in_memory = false;
+                return true;
+            }
+            std::ifstream in(fs_path, std::ios::binary);
+            if (!in.is_open())
+            {
+                LOG(ERROR) << "open " << fs_path << " error";
+                return false;
+            }
+            file->plain.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+            file->size = file->plain.size();
+            file->in_memory = true;
+            std::snprintf(tag, sizeof(tag), "\"%016llx\"", (unsigned long long)Hash(file->plain));
+            file->etag = tag;
+            if (Compressible(file->content_type) && file->size >= ns_compress::MIN_COMPRESS_SIZE)
+            {
+                // 启动时用最高压缩级别，压缩后没变小就不要了
+                if (!ns_compress::Gzip(file->plain.data(), file->size, &file->gzip, 9) || file->gzip.size() >= file->size)
+                    file->gzip.clear();
+                if (!ns_compress::Brotli(file->plain.data(), file->size, &file->br, BROTLI_MAX_QUALITY) || file->br.size() >= file->size)
+                    file->br.clear();
+            }
+            return true;
+        }
+
+        static uint64_t Hash(const std::string &s)
+        {
+            uint64_t h = 14695981039346656037ULL; // FNV-1a
+            for (unsigned char c : s)
+            {
+                h ^= c;
+                h *= 1099511628211ULL;
+            }
+            return h;
+        }
+
+        static bool Compressible(const std::string &type)
+        {
+            return type.compare(0, 5, "text/") == 0 || type.compare(0, 22, "application/javascript") == 0 ||
+                   type.compare(0, 16, "application/json") == 0 || type == "image/svg+xml";
+        }
+
+        static const char *ContentType(const std::string &path)
+        {
+            size_t dot = path.rfind('.');
+            std::string ext = dot == std::string::npos ? "" : path.substr(dot + 1);
+            ns_util::StringUtil::ToLowerAscii(&ext);
+            if (ext == "html" || ext == "htm")
+                return "text/html;charset=utf-8";
+            if (ext == "css")
+                return "text/css";
+            if (ext == "js")
+                return "application/javascript";
+            if (ext == "json")
+                return "application/json";
+            if (ext == "txt")
+                return "text/plain;charset=utf-8";
+            if (ext == "svg")
+                return "image/svg+xml";
+            if (ext == "png")
+                return "image/png";
+            if (ext == "jpg" || ext == "jpeg")
+                return "image/jpeg";
+            if (ext == "gif")
+                return "image/gif";
+            if (ext == "ico")
+                return "image/x-icon";
+            return "application/octet-stream";
+        }
+
+        // inotify不会递归，根目录和每个子目录各加一个watch（重复添加同一目录会复用原来的watch）
+        void AddWatches()
+        {
+            namespace fs = boost::filesystem;
+            const uint32_t mask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+            inotify_add_watch(_inotify_fd, _root.c_str(), mask);
+            boost::system::error_code ec;
+            fs::recursive_directory_iterator end;
+            for (fs::recursive_directory_iterator iter(_root, ec); !ec && iter != end; iter.increment(ec))
+            {
+                if (fs::is_directory(iter->status()))
+                    inotify_add_watch(_inotify_fd, iter->path().string().c_str(), mask);
+            }
+        }
+
+        void Watch()
+        {
+            char buf[4096];
+            while (!_stop)
+            {
+                struct pollfd pfd;
+                pfd.fd = _inotify_fd;
+                pfd.events = POLLIN;
+                if (poll(&pfd, 1, 500) <= 0)
+                    continue;
+                // 编辑器保存一次往往触发好几个事件，稍等一下把它们合成一次重新加载
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                while (read(_inotify_fd, buf, sizeof(buf)) > 0)
+                    ;
+                LOG(INFO) << _root << " 有变化，重新加载静态文件";
+                Reload();
+                AddWatches();
+            }
+        }
+
+    private:
+        std::string _root;
+        size_t _max_age;      // 非html资源的Cache-Control max-age（秒）
+        size_t _memory_limit; // 超过这个大小的文件不进内存
+        std::shared_ptr<const FileMap> _files;
+        int _inotify_fd;
+        std::atomic<bool> _stop;
+        std::thread _watcher;
+    };
+}
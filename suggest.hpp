@@ -0,0 +1,154 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <unordered_map>
+#include <algorithm>
+#include "termdict.hpp"
+
+namespace ns_suggest
+{
+    struct Suggestion
+    {
+        std::string word; // 补全出来的词条
+        uint32_t count;   // 文档频率
+    };
+
+    // 前缀补全：有序词条字典里以同一前缀开头的词条正好是一段连续区间。
+    // 区间较大的前缀预先算好文档频率最高的TOP_K个词条（存名次），
+    // 区间较小的前缀直接在字典上扫描这一小段，两种情况都只碰很少的词条
+    class Suggester
+    {
+    public:
+        static const size_t TOP_K = 10;     // 每个前缀最多返回的补全数
+        static const size_t THRESHOLD = 64; // 区间词条数达到这个值才预先计算
+        static const size_t MAX_DEPTH = 32; // 预先计算的最长前缀（字节）
+
+        Suggester() : _dict(nullptr) {}
+
+        // doc_freq(value)返回词条的文档频率，value是词条字典里的值
+        template <class DocFreq>
+        void Build(const ns_termdict::SortedTermDict &dict, DocFreq doc_freq)
+        {
+            _dict = &dict;
+            _top.clear();
+            _counts.assign(dict.Size(), 0);
+
+            // 按字典序扫一遍，栈里第i层是当前词条长度为i+1的前缀，
+            // 与上一个词条的公共前缀之外的层在离开时结算
+            std::vector<Level> stack;
+            std::string prev;
+            for (auto iter = dict.LowerBound(ns_util::StringView()); iter.Valid(); iter.Next())
+            {
+                ns_util::StringView term = iter.Term();
+                uint32_t count = (uint32_t)doc_freq(iter.Value());
+                _counts[iter.Ordinal()] = count;
+
+                size_t common = 0;
+                size_t limit = std::min(prev.size(), term.size());
+                while (common < limit && prev[common] == term[common])
+                    ++common;
+                while (stack.size() > common)
+                {
+                    Settle(prev, stack.size(), &stack.back());
+                    stack.pop_back();
+                }
+                size_t depth = term.size() < MAX_DEPTH ? term.size() : MAX_DEPTH;
+                while (stack.size() < depth)
+                    stack.push_back(Level());
+                for (auto &level : stack)
+                    level.Add(count, (uint32_t)iter.Ordinal());
+                prev.assign(term.data(), term.size());
+            }
+            while (!stack.empty())
+            {
+                Settle(prev, stack.size(), &stack.back());
+                stack.pop_back();
+            }
+        }
+
+        // prefix需要已经转成小写，返回最多n个补全，按文档频率降序
+        void Suggest(const std::string &prefix, size_t n, std::vector<Suggestion> *out) const
+        {
+            out->clear();
+            if (_dict == nullptr || prefix.empty() || n == 0)
+                return;
+            if (n > TOP_K)
+                n = TOP_K;
+
+            auto found = _top.find(prefix);
+            if (found != _top.end())
+            {
+                for (size_t i = 0; i < found->second.size() && i < n; i++)
+                {
+                    uint32_t ordinal = found->second[i];
+                    auto iter = _dict->Seek(ordinal);
+                    Suggestion s;
+                    s.word = iter.Term().ToString();
+                    s.count = _counts[ordinal];
+                    out->push_back(std::move(s));
+                }
+                return;
+            }
+
+            // 小区间直接扫描
+            std::vector<Suggestion> all;
+            for (auto iter = _dict->LowerBound(prefix); iter.Valid(); iter.Next())
+            {
+                ns_util::StringView term = iter.Term();
+                if (term.size() < prefix.size() || std::memcmp(term.data(), prefix.data(), prefix.size()) != 0)
+                    break;
+                Suggestion s;
+                s.word = term.ToString();
+                s.count = _counts[iter.Ordinal()];
+                all.push_back(std::move(s));
+                if (all.size() >= THRESHOLD * 4) // 超过MAX_DEPTH的长前缀兜底，避免意外的长扫描
+                    break;
+            }
+            size_t keep = std::min(n, all.size());
+            std::partial_sort(all.begin(), all.begin() + keep, all.end(), [](const Suggestion &a, const Suggestion &b)
+                              { return a.count > b.count || (a.count == b.count && a.word < b.word); });
+            for (size_t i = 0; i < keep; i++)
+                out->push_back(std::move(all[i]));
+        }
+
+        size_t PrecomputedPrefixes() const { return _top.size(); }
+
+    private:
+        // 一层前缀：区间内词条数和文档频率最高的TOP_K个词条
+        struct Level
+        {
+            size_t total = 0;
+            std::vector<std::pair<uint32_t, uint32_t>> best; // (count, ordinal)，降序
+
+            void Add(uint32_t count, uint32_t ordinal)
+            {
+                ++total;
+                if (best.size() == TOP_K && best.back().first >= count)
+                    return;
+                auto pos = best.begin();
+                while (pos != best.end() && pos->first >= count)
+                    ++pos;
+                best.insert(pos, std::make_pair(count, ordinal));
+                if (best.size() > TOP_K)
+                    best.pop_back();
+            }
+        };
+
+        void Settle(const std::string &term, size_t len, Level *level)
+        {
+            if (level->total < THRESHOLD)
+                return;
+            std::vector<uint32_t> &ordinals = _top[term.substr(0, len)];
+            for (auto &p : level->best)
+                ordinals.push_back(p.second);
+        }
+
+    private:
+        const ns_termdict::SortedTermDict *_dict;
+        std::vector<uint32_t> _counts;                                // 名次 -> 文档频率
+        std::unordered_map<std::string, std::vector<uint32_t>> _top; // 前缀 -> TOP_K名次
+    };
+}
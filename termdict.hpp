@@ -0,0 +1,407 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include "util.hpp"
+
+namespace ns_termdict
+{
+    // 追加式的内存池：词条字符串连续放在大块内存里，只分配不释放，地址稳定
+    class Arena
+    {
+    public:
+        explicit Arena(size_t chunk_size = 64 * 1024) : _chunk_size(chunk_size), _ptr(nullptr), _left(0), _bytes(0) {}
+        Arena(const Arena &) = delete;
+        Arena &operator=(const Arena &) = delete;
+
+        const char *Copy(const char *data, size_t len)
+        {
+            if (len > _left)
+            {
+                // 超长的词条单独占一块，不浪费当前块的剩余空间
+                size_t size = len > _chunk_size / 4 ? len : _chunk_size;
+                _chunks.emplace_back(new char[size]);
+                _bytes += size;
+                if (size != _chunk_size)
+                {
+                    std::memcpy(_chunks.back().get(), data, len);
+                    return _chunks.back().get();
+                }
+                _ptr = _chunks.back().get();
+                _left = size;
+            }
+            char *p = _ptr;
+            std::memcpy(p, data, len);
+            _ptr += len;
+            _left -= len;
+            return p;
+        }
+
+        void Clear()
+        {
+            _chunks.clear();
+            _ptr = nullptr;
+            _left = 0;
+            _bytes = 0;
+        }
+
+        size_t Bytes() const { return _bytes; }
+
+    private:
+        size_t _chunk_size;
+        std::vector<std::unique_ptr<char[]>> _chunks;
+        char *_ptr;
+        size_t _left;
+        size_t _bytes;
+    };
+
+    // 词条字典：把词条字符串驻留到Arena里，按插入顺序分配稳定的id(0, 1, 2 ...)
+    // 查找用开放寻址（线性探测）的哈希表，槽里只存id+1，0表示空槽
+    class TermDict
+    {
+    public:
+        static const uint32_t NPOS = 0xffffffffu;
+
+        TermDict() : _slots(1024, 0), _mask(1023) {}
+        TermDict(const TermDict &) = delete;
+        TermDict &operator=(const TermDict &) = delete;
+
+        // 返回词条id，不存在就插入
+        uint32_t Intern(const char *data, size_t len)
+        {
+            uint32_t h = Hash(data, len);
+            size_t pos = h & _mask;
+            while (_slots[pos] != 0)
+            {
+                const Entry &e = _terms[_slots[pos] - 1];
+                if (e.hash == h && e.len == len && std::memcmp(e.data, data, len) == 0)
+                    return _slots[pos] - 1;
+                pos = (pos + 1) & _mask;
+            }
+            Entry e;
+            e.data = _arena.Copy(data, len);
+            e.len = (uint32_t)len;
+            e.hash = h;
+            _terms.push_back(e);
+            uint32_t id = (uint32_t)_terms.size() - 1;
+            _slots[pos] = id + 1;
+            // 装载因子超过0.7就扩容
+            if (_terms.size() * 10 > _slots.size() * 7)
+                Rehash(_slots.size() * 2);
+            return id;
+        }
+        uint32_t Intern(const std::string &term) { return Intern(term.data(), term.size()); }
+
+        // 查找词条id，不存在返回NPOS
+        uint32_t Find(const char *data, size_t len) const
+        {
+            uint32_t h = Hash(data, len);
+            size_t pos = h & _mask;
+            while (_slots[pos] != 0)
+            {
+                const Entry &e = _terms[_slots[pos] - 1];
+                if (e.hash == h && e.len == len && std::memcmp(e.data, data, len) == 0)
+                    return _slots[pos] - 1;
+                pos = (pos + 1) & _mask;
+            }
+            return NPOS;
+        }
+        uint32_t Find(const std::string &term) const { return Find(term.data(), term.size()); }
+
+        ns_util::StringView Term(uint32_t id) const
+        {
+            return ns_util::StringView(_terms[id].data, _terms[id].len);
+        }
+
+        size_t Size() const { return _terms.size(); }
+        size_t MemoryBytes() const
+        {
+            return _arena.Bytes() + _terms.capacity() * sizeof(Entry) + _slots.capacity() * sizeof(uint32_t);
+        }
+
+        // 释放全部词条和哈希表
+        void Clear()
+        {
+            _arena.Clear();
+            std::vector<Entry>().swap(_terms);
+            std::vector<uint32_t>(1024, 0).swap(_slots);
+            _mask = 1023;
+        }
+
+    private:
+        struct Entry
+        {
+            const char *data;
+            uint32_t len;
+            uint32_t hash;
+        };
+
+        // FNV-1a
+        static uint32_t Hash(const char *data, size_t len)
+        {
+            uint32_t h = 2166136261u;
+            for (size_t i = 0; i < len; i++)
+            {
+                h ^= (unsigned char)data[i];
+                h *= 16777619u;
+            }
+            return h;
+        }
+
+        void Rehash(size_t new_size)
+        {
+            std::vector<uint32_t> slots(new_size, 0);
+            size_t mask = new_size - 1;
+            for (uint32_t id = 0; id < _terms.size(); id++)
+            {
+                size_t pos = _terms[id].hash & mask;
+                while (slots[pos] != 0)
+                    pos = (pos + 1) & mask;
+                slots[pos] = id + 1;
+            }
+            _slots.swap(slots);
+            _mask = mask;
+        }
+
+    private:
+        Arena _arena;
+        std::vector<Entry> _terms;   // 下标即词条id
+        std::vector<uint32_t> _slots; // 哈希槽，大小是2的幂
+        size_t _mask;
+    };
+
+    // 只读的有序词条字典：词条按字节序排好，每BLOCK个一组做前缀压缩（front coding），
+    // 每组第一个词条完整存放，用来二分查找；其余词条只存与前一个词条不同的后缀。
+    // 支持精确查找、前缀遍历和区间扫描，value是建字典时传入的倒排拉链下标
+    class SortedTermDict
+    {
+    public:
+        static const uint32_t NPOS = 0xffffffffu;
+        static const size_t BLOCK = 16;
+
+        // 顺序迭代器，Valid()为false表示已经走到末尾
+        class Iterator
+        {
+        public:
+            bool Valid() const { return _dict != nullptr && _ordinal < _dict->_size; }
+            ns_util::StringView Term() const { return ns_util::StringView(_term); }
+            uint32_t Value() const { return _value; }
+            size_t Ordinal() const { return _ordinal; } // 在有序数组中的名次
+            void Next()
+            {
+                ++_ordinal;
+                if (!Valid())
+                    return;
+                if (_ordinal % BLOCK == 0)
+                    _dict->DecodeHead(_ordinal / BLOCK, &_pos, &_term, &_value);
+                else
+                    _dict->DecodeNext(&_pos, &_term, &_value);
+            }
+
+        private:
+            friend class SortedTermDict;
+            Iterator() : _dict(nullptr), _ordinal(0), _pos(nullptr), _value(0) {}
+
+            const SortedTermDict *_dict;
+            size_t _ordinal;
+            const char *_pos; // 下一个词条的编码位置
+            std::string _term;
+            uint32_t _value;
+        };
+
+        SortedTermDict() : _size(0) {}
+
+        // 从TermDict构建，value就是TermDict里的词条id
+        void Build(const TermDict &dict)
+        {
+            std::vector<uint32_t> ids(dict.Size());
+            for (uint32_t i = 0; i < ids.size(); i++)
+                ids[i] = i;
+            std::sort(ids.begin(), ids.end(), [&dict](uint32_t a, uint32_t b)
+                      { return Less(dict.Term(a), dict.Term(b)); });
+
+            _data.clear();
+            _blocks.clear();
+            _size = ids.size();
+            ns_util::StringView prev;
+            for (size_t i = 0; i < ids.size(); i++)
+            {
+                ns_util::StringView term = dict.Term(ids[i]);
+                if (i % BLOCK == 0)
+                {
+                    _blocks.push_back((uint32_t)_data.size());
+                    PutVarint(term.size());
+                    _data.append(term.data(), term.size());
+                }
+                else
+                {
+                    size_t shared = 0;
+                    size_t limit = std::min(prev.size(), term.size());
+                    while (shared < limit && prev[shared] == term[shared])
+                        ++shared;
+                    PutVarint(shared);
+                    PutVarint(term.size() - shared);
+                    _data.append(term.data() + shared, term.size() - shared);
+                }
+                PutVarint(ids[i]);
+                prev = term;
+            }
+            _data.shrink_to_fit();
+            _blocks.shrink_to_fit();
+        }
+
+        // 精确查找，返回value，不存在返回NPOS
+        uint32_t Find(const ns_util::StringView &key) const
+        {
+            Iterator iter = LowerBound(key);
+            if (iter.Valid() && Compare(iter.Term(), key) == 0)
+                return iter.Value();
+            return NPOS;
+        }
+
+        // 第一个>=key的词条
+        Iterator LowerBound(const ns_util::StringView &key) const
+        {
+            Iterator iter;
+            iter._dict = this;
+            if (_size == 0)
+                return iter;
+            // 找最后一个组首词条<=key的组
+            size_t lo = 0, hi = _blocks.size();
+            while (hi - lo > 1)
+            {
+                size_t mid = (lo + hi) / 2;
+                if (Compare(HeadTerm(mid), key) <= 0)
+                    lo = mid;
+                else
+                    hi = mid;
+            }
+            iter._ordinal = lo * BLOCK;
+            DecodeHead(lo, &iter._pos, &iter._term, &iter._value);
+            while (iter.Valid() && Compare(iter.Term(), key) < 0)
+                iter.Next();
+            return iter;
+        }
+
+        // 定位到名次为ordinal的词条
+        Iterator Seek(size_t ordinal) const
+        {
+            Iterator iter;
+            iter._dict = this;
+            iter._ordinal = ordinal;
+            if (ordinal >= _size)
+                return iter;
+            size_t block = ordinal / BLOCK;
+            iter._ordinal = block * BLOCK;
+            DecodeHead(block, &iter._pos, &iter._term, &iter._value);
+            while (iter._ordinal < ordinal)
+                iter.Next();
+            return iter;
+        }
+
+        // 依次回调以prefix开头的词条，回调返回false时停止
+        template <class Callback>
+        void ForEachPrefix(const ns_util::StringView &prefix, Callback callback) const
+        {
+            for (Iterator iter = LowerBound(prefix); iter.Valid(); iter.Next())
+            {
+                ns_util::StringView term = iter.Term();
+                if (term.size() < prefix.size() || std::memcmp(term.data(), prefix.data(), prefix.size()) != 0)
+                    break;
+                if (!callback(term, iter.Value()))
+                    break;
+            }
+        }
+
+        // 依次回调[lo, hi)区间内的词条，回调返回false时停止
+        template <class Callback>
+        void ForEachRange(const ns_util::StringView &lo, const ns_util::StringView &hi, Callback callback) const
+        {
+            for (Iterator iter = LowerBound(lo); iter.Valid(); iter.Next())
+            {
+                if (Compare(iter.Term(), hi) >= 0)
+                    break;
+                if (!callback(iter.Term(), iter.Value()))
+                    break;
+            }
+        }
+
+        size_t Size() const { return _size; }
+        size_t MemoryBytes() const { return _data.capacity() + _blocks.capacity() * sizeof(uint32_t); }
+
+    private:
+        static int Compare(const ns_util::StringView &a, const ns_util::StringView &b)
+        {
+            size_t n = std::min(a.size(), b.size());
+            int r = n == 0 ? 0 : std::memcmp(a.data(), b.data(), n);
+            if (r != 0)
+                return r;
+            return a.size() < b.size() ? -1 : (a.size() > b.size() ? 1 : 0);
+        }
+        static bool Less(const ns_util::StringView &a, const ns_util::StringView &b)
+        {
+            return Compare(a, b) < 0;
+        }
+
+        void PutVarint(size_t v)
+        {
+            while (v >= 0x80)
+            {
+                _data.push_back((char)(v | 0x80));
+                v >>= 7;
+            }
+            _data.push_back((char)v);
+        }
+        static size_t GetVarint(const char **p)
+        {
+            size_t v = 0;
+            int shift = 0;
+            const unsigned char *q = (const unsigned char *)*p;
+            while (*q & 0x80)
+            {
+                v |= (size_t)(*q & 0x7f) << shift;
+                shift += 7;
+                ++q;
+            }
+            v |= (size_t)*q << shift;
+            *p = (const char *)(q + 1);
+            return v;
+        }
+
+        ns_util::StringView HeadTerm(size_t block) const
+        {
+            const char *p = _data.data() + _blocks[block];
+            size_t len = GetVarint(&p);
+            return ns_util::StringView(p, len);
+        }
+        void DecodeHead(size_t block, const char **pos, std::string *term, uint32_t *value) const
+        {
+            const char *p = _data.data() + _blocks[block];
+            size_t len = GetVarint(&p);
+            term->assign(p, len);
+            p += len;
+            *value = (uint32_t)GetVarint(&p);
+            *pos = p;
+        }
+        void DecodeNext(const char **pos, std::string *term, uint32_t *value) const
+        {
+            const char *p = *pos;
+            size_t shared = GetVarint(&p);
+            size_t len = GetVarint(&p);
+            term->resize(shared);
+            term->append(p, len);
+            p += len;
+            *value = (uint32_t)GetVarint(&p);
+            *pos = p;
+        }
+
+    private:
+        std::string _data;            // 所有组的编码首尾相接
+        std::vector<uint32_t> _blocks; // 每组在_data中的起始偏移
+        size_t _size;                 // 词条总数
+    };
+}
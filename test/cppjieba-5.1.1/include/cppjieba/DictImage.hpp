@@ -0,0 +1,246 @@
+#ifndef CPPJIEBA_DICT_IMAGE_H
+#define CPPJIEBA_DICT_IMAGE_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "limonp/Logging.hpp"
+#include "limonp/StringUtil.hpp"
+#include "Trie.hpp"
+
+namespace cppjieba {
+
+// A dictionary image is the dictionary, the user dictionary and the HMM model
+// after loading, written out as arrays of plain structs: the double-array
+// trie, the dict units, the weight statistics and the HMM probabilities.
+// Opening one is an mmap plus a checksum pass; the trie arrays are used in
+// place. The image also records a checksum of the text files it was compiled
+// from so a stale image can be detected.
+enum DictImageSection {
+  IMAGE_TRIE_UNITS = 0,   // TrieUnit[]
+  IMAGE_TRIE_CODES,       // uint32_t[], BMP rune -> code
+  IMAGE_TRIE_WIDE_CODES,  // uint32_t[] of (rune, code) pairs
+  IMAGE_DICT_UNITS,       // DictUnitRecord[], in the trie's value order
+  IMAGE_DICT_RUNES,       // Rune[] referenced by DictUnitRecord
+  IMAGE_DICT_TAGS,        // char[] referenced by DictUnitRecord
+  IMAGE_DICT_STATS,       // DictStatsRecord
+  IMAGE_DICT_USER_SINGLE, // Rune[], single-rune words of the user dict
+  IMAGE_HMM_PROBS,        // HMMProbsRecord
+  IMAGE_HMM_EMIT,         // HMMEmitRecord[]
+  IMAGE_SECTION_NUM
+}; // enum DictImageSection
+
+struct DictUnitRecord {
+  double weight;
+  uint32_t word_offset;
+  uint32_t word_len;
+  uint32_t tag_offset;
+  uint32_t tag_len;
+}; // struct DictUnitRecord
+
+struct DictStatsRecord {
+  double freq_sum;
+  double min_weight;
+  double max_weight;
+  double median_weight;
+  double user_word_default_weight;
+}; // struct DictStatsRecord
+
+struct HMMProbsRecord {
+  double start[4];
+  double trans[4][4];
+}; // struct HMMProbsRecord
+
+struct HMMEmitRecord {
+  uint32_t status;
+  Rune rune;
+  double prob;
+}; // struct HMMEmitRecord
+
+const char DICT_IMAGE_MAGIC[8] = {'J', 'I', 'E', 'B', 'A', 'I', 'M', 'G'};
+const uint32_t DICT_IMAGE_VERSION = 1;
+
+struct DictImageHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;
+  uint64_t source_checksum; // of the text files the image was compiled from
+  uint64_t body_checksum;   // of everything after the header
+  uint64_t body_size;
+  struct {
+    uint64_t offset; // from the start of the file, 8-byte aligned
+    uint64_t size;   // in bytes
+  } sections[IMAGE_SECTION_NUM];
+}; // struct DictImageHeader
+
+// FNV-1a over 64-bit words, the tail byte by byte
+inline uint64_t ImageChecksum(const void* data, size_t len, uint64_t h = 14695981039346656037ULL) {
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+  for (; len >= 8; p += 8, len -= 8) {
+    uint64_t word;
+    memcpy(&word, p, 8);
+    h = (h ^ word) * 1099511628211ULL;
+  }
+  for (; len > 0; p++, len--) {
+    h = (h ^ *p) * 1099511628211ULL;
+  }
+  return h;
+}
+
+class DictImage {
+ public:
+  DictImage(): data_(NULL), size_(0) {
+  }
+  ~DictImage() {
+    if (NULL != data_) {
+      munmap(data_, size_);
+    }
+  }
+
+  // mapped copy-on-write: InsertUserWord may change trie cells in place
+  bool Open(const string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(DictImageHeader)) {
+      close(fd);
+      XLOG(WARNING) << path << " is not a dict image";
+      return false;
+    }
+    void* data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == data) {
+      XLOG(WARNING) << "mmap " << path << " failed";
+      return false;
+    }
+    data_ = static_cast<char*>(data);
+    size_ = st.st_size;
+    if (!Verify()) {
+      XLOG(WARNING) << path << " is corrupted or from another version";
+      munmap(data_, size_);
+      data_ = NULL;
+      size_ = 0;
+      return false;
+    }
+    return true;
+  }
+
+  uint64_t SourceChecksum() const {
+    return Header()->source_checksum;
+  }
+
+  template <class T>
+  T* Section(DictImageSection id, size_t* count) const {
+    *count = Header()->sections[id].size / sizeof(T);
+    return reinterpret_cast<T*>(data_ + Header()->sections[id].offset);
+  }
+
+  // checksum of the contents of the given files, false if one can't be read.
+  // Each entry may list several files separated by '|' or ';' like user_dict_paths.
+  static bool SourceChecksum(const vector<string>& paths, uint64_t* checksum) {
+    uint64_t h = ImageChecksum(NULL, 0);
+    for (size_t i = 0; i < paths.size(); i++) {
+      vector<string> files = limonp::Split(paths[i], "|;");
+      for (size_t j = 0; j < files.size(); j++) {
+        ifstream ifs(files[j].c_str(), ios::binary);
+        if (!ifs.is_open()) {
+          return false;
+        }
+        string content((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+        h = ImageChecksum(content.data(), content.size(), h);
+      }
+      h = ImageChecksum("\0", 1, h); // so moving a file between entries changes the checksum
+    }
+    *checksum = h;
+    return true;
+  }
+
+ private:
+  const DictImageHeader* Header() const {
+    return reinterpret_cast<const DictImageHeader*>(data_);
+  }
+
+  bool Verify() const {
+    const DictImageHeader* header = Header();
+    if (memcmp(header->magic, DICT_IMAGE_MAGIC, sizeof(DICT_IMAGE_MAGIC)) != 0 ||
+          header->version != DICT_IMAGE_VERSION ||
+          header->header_size != sizeof(DictImageHeader) ||
+          header->body_size != size_ - sizeof(DictImageHeader)) {
+      return false;
+    }
+    for (size_t i = 0; i < IMAGE_SECTION_NUM; i++) {
+      uint64_t offset = header->sections[i].offset, size = header->sections[i].size;
+      if (offset % 8 != 0 || offset < sizeof(DictImageHeader) || offset > size_ || size > size_ - offset) {
+        return false;
+      }
+    }
+    return header->body_checksum == ImageChecksum(data_ + sizeof(DictImageHeader), header->body_size);
+  }
+
+  DictImage(const DictImage&);
+  DictImage& operator=(const DictImage&);
+
+  char* data_;
+  size_t size_;
+}; // class DictImage
+
+class DictImageWriter {
+ public:
+  template <class T>
+  void Add(DictImageSection id, const T* data, size_t count) {
+    sections_[id].assign(reinterpret_cast<const char*>(data), count * sizeof(T));
+  }
+
+  // written to path.tmp and renamed, so a running process never maps half an image
+  bool Write(const string& path, uint64_t source_checksum) const {
+    DictImageHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DICT_IMAGE_MAGIC, sizeof(DICT_IMAGE_MAGIC));
+    header.version = DICT_IMAGE_VERSION;
+    header.header_size = sizeof(DictImageHeader);
+    header.source_checksum = source_checksum;
+
+    string body;
+    for (size_t i = 0; i < IMAGE_SECTION_NUM; i++) {
+      body.resize((body.size() + 7) / 8 * 8, '\0');
+      header.sections[i].offset = sizeof(DictImageHeader) + body.size();
+      header.sections[i].size = sections_[i].size();
+      body += sections_[i];
+    }
+    header.body_size = body.size();
+    header.body_checksum = ImageChecksum(body.data(), body.size());
+
+    string tmp = path + ".tmp";
+    ofstream ofs(tmp.c_str(), ios::binary | ios::trunc);
+    if (!ofs.is_open()) {
+      XLOG(ERROR) << "open " << tmp << " failed";
+      return false;
+    }
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    ofs.write(body.data(), body.size());
+    ofs.close();
+    if (!ofs || rename(tmp.c_str(), path.c_str()) != 0) {
+      XLOG(ERROR) << "write " << path << " failed";
+      unlink(tmp.c_str());
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  string sections_[IMAGE_SECTION_NUM];
+}; // class DictImageWriter
+
+} // namespace cppjieba
+
+#endif // CPPJIEBA_DICT_IMAGE_H
@@ -10,10 +10,12 @@
 #include <stdint.h>
 #include <cmath>
 #include <limits>
+#include <memory>
 #include "limonp/StringUtil.hpp"
 #include "limonp/Logging.hpp"
 #include "Unicode.hpp"
 #include "Trie.hpp"
+#include "DictImage.hpp"
 
 namespace cppjieba {
 
@@ -32,10 +34,16 @@ class DictTrie {
     WordWeightMax,
   }; // enum UserWordWeightOption
 
-  DictTrie(const string& dict_path, const string& user_dict_paths = "", UserWordWeightOption user_word_weight_opt = WordWeightMedian) {
+  DictTrie(const string& dict_path, const string& user_dict_paths = "", UserWordWeightOption user_word_weight_opt = WordWeightMedian)
+    : has_ascii_word_(false) {
     Init(dict_path, user_dict_paths, user_word_weight_opt);
   }
 
+  // from a compiled image (see Save); the trie arrays stay in the image's mapping
+  explicit DictTrie(const std::shared_ptr<DictImage>& image) : image_(image), has_ascii_word_(false) {
+    LoadImage(*image);
+  }
+
   ~DictTrie() {
     delete trie_;
   }
@@ -47,6 +55,7 @@ class DictTrie {
     }
     active_node_infos_.push_back(node_info);
     trie_->InsertNode(node_info.word, &active_node_infos_.back());
+    NoteAsciiWord(node_info.word);
     return true;
   }
 
@@ -58,6 +67,7 @@ class DictTrie {
     }
     active_node_infos_.push_back(node_info);
     trie_->InsertNode(node_info.word, &active_node_infos_.back());
+    NoteAsciiWord(node_info.word);
     return true;
   }
 
@@ -108,6 +118,12 @@ class DictTrie {
     return min_weight_;
   }
 
+  // Whether some word consists of ASCII runes only. When none does, the DAG
+  // of an ASCII span has no edges and segmenters may skip building it.
+  bool HasAsciiWord() const {
+    return has_ascii_word_;
+  }
+
   void InserUserDictNode(const string& line) {
     vector<string> buf;
     DictUnit node_info;
@@ -147,6 +163,43 @@ class DictTrie {
     }
   }
 
+  // write everything LoadImage needs. Call it on a freshly loaded DictTrie:
+  // words inserted at runtime are not saved.
+  void Save(DictImageWriter& writer) const {
+    writer.Add(IMAGE_TRIE_UNITS, trie_->Units(), trie_->Size());
+    writer.Add(IMAGE_TRIE_CODES, trie_->Codes(), trie_->CodesSize());
+    vector<pair<Rune, uint32_t> > wide = trie_->WideCodes();
+    vector<uint32_t> wide_flat;
+    for (size_t i = 0; i < wide.size(); i++) {
+      wide_flat.push_back(wide[i].first);
+      wide_flat.push_back(wide[i].second);
+    }
+    writer.Add(IMAGE_TRIE_WIDE_CODES, wide_flat.data(), wide_flat.size());
+
+    vector<DictUnitRecord> records(static_node_infos_.size());
+    vector<Rune> runes;
+    string tags;
+    for (size_t i = 0; i < static_node_infos_.size(); i++) {
+      const DictUnit& unit = static_node_infos_[i];
+      records[i].weight = unit.weight;
+      records[i].word_offset = runes.size();
+      records[i].word_len = unit.word.size();
+      records[i].tag_offset = tags.size();
+      records[i].tag_len = unit.tag.size();
+      runes.insert(runes.end(), unit.word.begin(), unit.word.end());
+      tags += unit.tag;
+    }
+    writer.Add(IMAGE_DICT_UNITS, records.data(), records.size());
+    writer.Add(IMAGE_DICT_RUNES, runes.data(), runes.size());
+    writer.Add(IMAGE_DICT_TAGS, tags.data(), tags.size());
+
+    DictStatsRecord stats = {freq_sum_, min_weight_, max_weight_, median_weight_, user_word_default_weight_};
+    writer.Add(IMAGE_DICT_STATS, &stats, 1);
+    vector<Rune> singles(user_dict_single_chinese_word_.begin(), user_dict_single_chinese_word_.end());
+    sort(singles.begin(), singles.end());
+    writer.Add(IMAGE_DICT_USER_SINGLE, singles.data(), singles.size());
+  }
+
   void LoadUserDict(const string& filePaths) {
     vector<string> files = limonp::Split(filePaths, "|;");
     size_t lineno = 0;
@@ -179,6 +232,46 @@ class DictTrie {
     CreateTrie(static_node_infos_);
   }
   
+  void LoadImage(const DictImage& image) {
+    size_t n = 0, rune_num = 0, tag_num = 0;
+    const DictUnitRecord* records = image.Section<DictUnitRecord>(IMAGE_DICT_UNITS, &n);
+    const Rune* runes = image.Section<Rune>(IMAGE_DICT_RUNES, &rune_num);
+    const char* tags = image.Section<char>(IMAGE_DICT_TAGS, &tag_num);
+    static_node_infos_.resize(n);
+    vector<const DictUnit*> valuePointers(n);
+    for (size_t i = 0; i < n; i++) {
+      DictUnit& unit = static_node_infos_[i];
+      XCHECK(records[i].word_offset + records[i].word_len <= rune_num && records[i].tag_offset + records[i].tag_len <= tag_num);
+      unit.word = Unicode(runes + records[i].word_offset, runes + records[i].word_offset + records[i].word_len);
+      unit.weight = records[i].weight;
+      unit.tag.assign(tags + records[i].tag_offset, records[i].tag_len);
+      valuePointers[i] = &unit;
+      NoteAsciiWord(unit.word);
+    }
+
+    size_t num = 0;
+    const DictStatsRecord* stats = image.Section<DictStatsRecord>(IMAGE_DICT_STATS, &num);
+    XCHECK(num == 1);
+    freq_sum_ = stats->freq_sum;
+    min_weight_ = stats->min_weight;
+    max_weight_ = stats->max_weight;
+    median_weight_ = stats->median_weight;
+    user_word_default_weight_ = stats->user_word_default_weight;
+    const Rune* singles = image.Section<Rune>(IMAGE_DICT_USER_SINGLE, &num);
+    user_dict_single_chinese_word_.insert(singles, singles + num);
+
+    size_t unit_num = 0, code_num = 0, wide_num = 0;
+    TrieUnit* units = image.Section<TrieUnit>(IMAGE_TRIE_UNITS, &unit_num);
+    const uint32_t* codes = image.Section<uint32_t>(IMAGE_TRIE_CODES, &code_num);
+    const uint32_t* wide_flat = image.Section<uint32_t>(IMAGE_TRIE_WIDE_CODES, &wide_num);
+    vector<pair<Rune, uint32_t> > wide;
+    for (size_t i = 0; i + 1 < wide_num; i += 2) {
+      wide.push_back(make_pair(wide_flat[i], wide_flat[i + 1]));
+    }
+    XCHECK(unit_num > 0);
+    trie_ = new Trie(units, unit_num, codes, code_num, wide, valuePointers);
+  }
+
   void CreateTrie(const vector<DictUnit>& dictUnits) {
     assert(dictUnits.size());
     vector<Unicode> words;
@@ -186,6 +279,7 @@ class DictTrie {
     for (size_t i = 0 ; i < dictUnits.size(); i ++) {
       words.push_back(dictUnits[i].word);
       valuePointers.push_back(&dictUnits[i]);
+      NoteAsciiWord(dictUnits[i].word);
     }
 
     trie_ = new Trie(words, valuePointers);
@@ -266,6 +360,16 @@ class DictTrie {
     }
   }
 
+  // only ever set: after deleting the last ASCII word the fast path stays off
+  void NoteAsciiWord(const Unicode& word) {
+    for (size_t i = 0; i < word.size(); i++) {
+      if (word[i] >= 0x80) {
+        return;
+      }
+    }
+    has_ascii_word_ = has_ascii_word_ || !word.empty();
+  }
+
   void Shrink(vector<DictUnit>& units) const {
     vector<DictUnit>(units.begin(), units.end()).swap(units);
   }
@@ -273,6 +377,7 @@ class DictTrie {
   vector<DictUnit> static_node_infos_;
   deque<DictUnit> active_node_infos_; // must not be vector
   Trie * trie_;
+  std::shared_ptr<DictImage> image_; // keeps the mapped trie arrays alive
 
   double freq_sum_;
   double min_weight_;
@@ -280,6 +385,7 @@ class DictTrie {
   double median_weight_;
   double user_word_default_weight_;
   unordered_set<Rune> user_dict_single_chinese_word_;
+  bool has_ascii_word_;
 };
 }
 
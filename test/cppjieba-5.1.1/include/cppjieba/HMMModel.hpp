@@ -3,12 +3,16 @@
 
 #include "limonp/StringUtil.hpp"
 #include "Trie.hpp"
+#include "DictImage.hpp"
 
 namespace cppjieba {
 
 using namespace limonp;
 typedef unordered_map<Rune, double> EmitProbMap;
 
+// what the model's -3.14e+100 "impossible" becomes in float
+const float MIN_FLOAT = -3.14e+38f;
+
 struct HMMModel {
   /*
    * STATUS:
@@ -17,6 +21,18 @@ struct HMMModel {
   enum {B = 0, E = 1, M = 2, S = 3, STATUS_SUM = 4};
 
   HMMModel(const string& modelPath) {
+    Init();
+    LoadModel(modelPath);
+    BuildFloatTables();
+  }
+  explicit HMMModel(const DictImage& image) {
+    Init();
+    LoadImage(image);
+    BuildFloatTables();
+  }
+  ~HMMModel() {
+  }
+  void Init() {
     memset(startProb, 0, sizeof(startProb));
     memset(transProb, 0, sizeof(transProb));
     statMap[0] = 'B';
@@ -27,9 +43,6 @@ struct HMMModel {
     emitProbVec.push_back(&emitProbE);
     emitProbVec.push_back(&emitProbM);
     emitProbVec.push_back(&emitProbS);
-    LoadModel(modelPath);
-  }
-  ~HMMModel() {
   }
   void LoadModel(const string& filePath) {
     ifstream ifile(filePath.c_str());
@@ -71,6 +84,43 @@ struct HMMModel {
     XCHECK(GetLine(ifile, line));
     XCHECK(LoadEmitProb(line, emitProbS));
   }
+  void Save(DictImageWriter& writer) const {
+    HMMProbsRecord probs;
+    memcpy(probs.start, startProb, sizeof(probs.start));
+    memcpy(probs.trans, transProb, sizeof(probs.trans));
+    writer.Add(IMAGE_HMM_PROBS, &probs, 1);
+    vector<HMMEmitRecord> emits;
+    for (size_t i = 0; i < STATUS_SUM; i++) {
+      vector<pair<Rune, double> > sorted(emitProbVec[i]->begin(), emitProbVec[i]->end());
+      sort(sorted.begin(), sorted.end());
+      for (size_t j = 0; j < sorted.size(); j++) {
+        HMMEmitRecord record = {uint32_t(i), sorted[j].first, sorted[j].second};
+        emits.push_back(record);
+      }
+    }
+    writer.Add(IMAGE_HMM_EMIT, emits.data(), emits.size());
+  }
+  void LoadImage(const DictImage& image) {
+    size_t num = 0;
+    const HMMProbsRecord* probs = image.Section<HMMProbsRecord>(IMAGE_HMM_PROBS, &num);
+    XCHECK(num == 1);
+    memcpy(startProb, probs->start, sizeof(startProb));
+    memcpy(transProb, probs->trans, sizeof(transProb));
+    const HMMEmitRecord* emits = image.Section<HMMEmitRecord>(IMAGE_HMM_EMIT, &num);
+    for (size_t i = 0; i < num; i++) {
+      XCHECK(emits[i].status < STATUS_SUM);
+      (*emitProbVec[emits[i].status])[emits[i].rune] = emits[i].prob;
+    }
+  }
+  // the emit probabilities of all four states for a rune, MIN_FLOAT where the
+  // model has none
+  const float* GetEmitRow(Rune key) const {
+    EmitRowMap::const_iterator cit = emitRows.find(key);
+    if (cit == emitRows.end()) {
+      return emitDefault.prob;
+    }
+    return cit->second.prob;
+  }
   double GetEmitProb(const EmitProbMap* ptMp, Rune key, 
         double defVal)const {
     EmitProbMap::const_iterator cit = ptMp->find(key);
@@ -79,6 +129,29 @@ struct HMMModel {
     }
     return cit->second;
   }
+  // float copies of the model used by HMMSegment::Viterbi
+  void BuildFloatTables() {
+    for (size_t i = 0; i < STATUS_SUM; i++) {
+      startProbF[i] = ToFloat(startProb[i]);
+      emitDefault.prob[i] = MIN_FLOAT;
+      for (size_t j = 0; j < STATUS_SUM; j++) {
+        transProbF[i][j] = ToFloat(transProb[i][j]);
+      }
+    }
+    emitRows.clear();
+    for (size_t i = 0; i < STATUS_SUM; i++) {
+      for (EmitProbMap::const_iterator it = emitProbVec[i]->begin(); it != emitProbVec[i]->end(); ++it) {
+        EmitRowMap::iterator row = emitRows.find(it->first);
+        if (row == emitRows.end()) {
+          row = emitRows.insert(make_pair(it->first, emitDefault)).first;
+        }
+        row->second.prob[i] = ToFloat(it->second);
+      }
+    }
+  }
+  static float ToFloat(double prob) {
+    return prob < MIN_FLOAT ? MIN_FLOAT : float(prob);
+  }
   bool GetLine(ifstream& ifile, string& line) {
     while (getline(ifile, line)) {
       Trim(line);
@@ -122,6 +195,17 @@ struct HMMModel {
   EmitProbMap emitProbM;
   EmitProbMap emitProbS;
   vector<EmitProbMap* > emitProbVec;
+
+  // The same model in float, for HMMSegment::Viterbi. The emit probabilities
+  // of the four states are kept together so a rune is looked up once.
+  struct EmitRow {
+    float prob[STATUS_SUM];
+  }; // struct EmitRow
+  typedef unordered_map<Rune, EmitRow> EmitRowMap;
+  float startProbF[STATUS_SUM];
+  float transProbF[STATUS_SUM][STATUS_SUM];
+  EmitRowMap emitRows;
+  EmitRow emitDefault;
 }; // struct HMMModel
 
 } // namespace cppjieba
@@ -7,6 +7,9 @@
 #include <cassert>
 #include "HMMModel.hpp"
 #include "SegmentBase.hpp"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace cppjieba {
 class HMMSegment: public SegmentBase {
@@ -44,12 +47,16 @@ class HMMSegment: public SegmentBase {
     GetWordsFromWordRanges(sentence, wrs, words);
   }
   void Cut(RuneStrArray::const_iterator begin, RuneStrArray::const_iterator end, vector<WordRange>& res) const {
+    SegmentContext ctx;
+    Cut(begin, end, res, ctx);
+  }
+  void Cut(RuneStrArray::const_iterator begin, RuneStrArray::const_iterator end, vector<WordRange>& res, SegmentContext& ctx) const {
     RuneStrArray::const_iterator left = begin;
     RuneStrArray::const_iterator right = begin;
     while (right != end) {
       if (right->rune < 0x80) {
         if (left != right) {
-          InternalCut(left, right, res);
+          InternalCut(left, right, res, ctx);
         }
         left = right;
         do {
@@ -71,7 +78,7 @@ class HMMSegment: public SegmentBase {
       }
     }
     if (left != right) {
-      InternalCut(left, right, res);
+      InternalCut(left, right, res, ctx);
     }
   }
  private:
@@ -111,9 +118,9 @@ class HMMSegment: public SegmentBase {
     }
     return begin;
   }
-  void InternalCut(RuneStrArray::const_iterator begin, RuneStrArray::const_iterator end, vector<WordRange>& res) const {
-    vector<size_t> status;
-    Viterbi(begin, end, status);
+  void InternalCut(RuneStrArray::const_iterator begin, RuneStrArray::const_iterator end, vector<WordRange>& res, SegmentContext& ctx) const {
+    Viterbi(begin, end, ctx);
+    const vector<size_t>& status = ctx.status;
 
     RuneStrArray::const_iterator left = begin;
     RuneStrArray::const_iterator right;
@@ -127,60 +134,87 @@ class HMMSegment: public SegmentBase {
     }
   }
 
+  // The best state sequence of [begin, end). Only the weights of the previous
+  // rune are needed, four floats; ctx.path keeps, for every rune and state,
+  // the state it came from. With SSE2 the four target states are relaxed
+  // together, one source state at a time. A candidate must be strictly
+  // greater to win, so ties go to the lowest source state as in the scalar
+  // loop, and a state no candidate reaches keeps MIN_FLOAT and E.
   void Viterbi(RuneStrArray::const_iterator begin, 
         RuneStrArray::const_iterator end, 
-        vector<size_t>& status) const {
-    size_t Y = HMMModel::STATUS_SUM;
-    size_t X = end - begin;
-
-    size_t XYSize = X * Y;
-    size_t now, old, stat;
-    double tmp, endE, endS;
-
-    vector<int> path(XYSize);
-    vector<double> weight(XYSize);
+        SegmentContext& ctx) const {
+    const size_t Y = HMMModel::STATUS_SUM;
+    const size_t X = end - begin;
+    ctx.path.resize(X * Y); // row 0 is never read
+    uint8_t* path = ctx.path.data();
+    vector<size_t>& status = ctx.status;
 
-    //start
+    float weight[Y];
+    const float* emit = model_->GetEmitRow(begin->rune);
     for (size_t y = 0; y < Y; y++) {
-      weight[0 + y * X] = model_->startProb[y] + model_->GetEmitProb(model_->emitProbVec[y], begin->rune, MIN_DOUBLE);
-      path[0 + y * X] = -1;
+      weight[y] = model_->startProbF[y] + emit[y];
     }
 
-    double emitProb;
-
+#ifdef __SSE2__
+    __m128 prev = _mm_loadu_ps(weight);
+    const __m128 trans0 = _mm_loadu_ps(model_->transProbF[0]);
+    const __m128 trans1 = _mm_loadu_ps(model_->transProbF[1]);
+    const __m128 trans2 = _mm_loadu_ps(model_->transProbF[2]);
+    const __m128 trans3 = _mm_loadu_ps(model_->transProbF[3]);
+    for (size_t x = 1; x < X; x++) {
+      const __m128 e = _mm_loadu_ps(model_->GetEmitRow((begin + x)->rune));
+      __m128 best = _mm_set1_ps(MIN_FLOAT);
+      __m128i from = _mm_set1_epi32(HMMModel::E);
+      Relax(_mm_shuffle_ps(prev, prev, 0x00), trans0, e, 0, best, from);
+      Relax(_mm_shuffle_ps(prev, prev, 0x55), trans1, e, 1, best, from);
+      Relax(_mm_shuffle_ps(prev, prev, 0xaa), trans2, e, 2, best, from);
+      Relax(_mm_shuffle_ps(prev, prev, 0xff), trans3, e, 3, best, from);
+      prev = best;
+      from = _mm_packs_epi32(from, from);
+      int32_t packed = _mm_cvtsi128_si32(_mm_packus_epi16(from, from));
+      memcpy(path + x * Y, &packed, Y);
+    }
+    _mm_storeu_ps(weight, prev);
+#else
     for (size_t x = 1; x < X; x++) {
+      emit = model_->GetEmitRow((begin + x)->rune);
+      float next[Y];
       for (size_t y = 0; y < Y; y++) {
-        now = x + y*X;
-        weight[now] = MIN_DOUBLE;
-        path[now] = HMMModel::E; // warning
-        emitProb = model_->GetEmitProb(model_->emitProbVec[y], (begin+x)->rune, MIN_DOUBLE);
+        next[y] = MIN_FLOAT;
+        path[x * Y + y] = HMMModel::E;
         for (size_t preY = 0; preY < Y; preY++) {
-          old = x - 1 + preY * X;
-          tmp = weight[old] + model_->transProb[preY][y] + emitProb;
-          if (tmp > weight[now]) {
-            weight[now] = tmp;
-            path[now] = preY;
+          float tmp = weight[preY] + model_->transProbF[preY][y] + emit[y];
+          if (tmp > next[y]) {
+            next[y] = tmp;
+            path[x * Y + y] = preY;
           }
         }
       }
+      memcpy(weight, next, sizeof(weight));
     }
+#endif
 
-    endE = weight[X-1+HMMModel::E*X];
-    endS = weight[X-1+HMMModel::S*X];
-    stat = 0;
-    if (endE >= endS) {
-      stat = HMMModel::E;
-    } else {
-      stat = HMMModel::S;
-    }
-
+    size_t stat = weight[HMMModel::E] >= weight[HMMModel::S] ? HMMModel::E : HMMModel::S;
     status.resize(X);
-    for (int x = X -1 ; x >= 0; x--) {
+    for (size_t x = X; x-- > 0; ) {
       status[x] = stat;
-      stat = path[x + stat*X];
+      if (x > 0) {
+        stat = path[x * Y + stat];
+      }
     }
   }
 
+#ifdef __SSE2__
+  // candidates coming from state from_state: prev weight + transition + emit
+  static void Relax(__m128 prev, __m128 trans, __m128 emit, int from_state, __m128& best, __m128i& from) {
+    __m128 cand = _mm_add_ps(_mm_add_ps(prev, trans), emit);
+    __m128 gt = _mm_cmpgt_ps(cand, best);
+    best = _mm_or_ps(_mm_and_ps(gt, cand), _mm_andnot_ps(gt, best));
+    __m128i gti = _mm_castps_si128(gt);
+    from = _mm_or_si128(_mm_and_si128(gti, _mm_set1_epi32(from_state)), _mm_andnot_si128(gti, from));
+  }
+#endif
+
   const HMMModel* model_;
   bool isNeedDestroy_;
 }; // class HMMSegment
@@ -22,9 +22,56 @@ class Jieba {
       query_seg_(&dict_trie_, &model_),
       extractor(&dict_trie_, &model_, idfPath, stopWordPath) {
   }
+  // dictionary and HMM model from a compiled image, see CompileImage
+  Jieba(const std::shared_ptr<DictImage>& image,
+        const string& idfPath,
+        const string& stopWordPath)
+    : dict_trie_(image),
+      model_(*image),
+      mp_seg_(&dict_trie_),
+      hmm_seg_(&model_),
+      mix_seg_(&dict_trie_, &model_),
+      full_seg_(&dict_trie_),
+      query_seg_(&dict_trie_, &model_),
+      extractor(&dict_trie_, &model_, idfPath, stopWordPath) {
+  }
   ~Jieba() {
   }
 
+  // load the text dictionary, user dictionary and HMM model once and write them to image_path
+  static bool CompileImage(const string& dict_path,
+        const string& model_path,
+        const string& user_dict_path,
+        const string& image_path) {
+    uint64_t checksum = 0;
+    if (!DictImage::SourceChecksum(ImageSources(dict_path, model_path, user_dict_path), &checksum)) {
+      XLOG(ERROR) << "read " << dict_path << ", " << model_path << " or " << user_dict_path << " failed";
+      return false;
+    }
+    DictTrie dict_trie(dict_path, user_dict_path);
+    HMMModel model(model_path);
+    DictImageWriter writer;
+    dict_trie.Save(writer);
+    model.Save(writer);
+    return writer.Write(image_path, checksum);
+  }
+
+  // the image at image_path if it was compiled from the current contents of
+  // these files, otherwise NULL (missing, corrupted or stale)
+  static std::shared_ptr<DictImage> OpenImage(const string& image_path,
+        const string& dict_path,
+        const string& model_path,
+        const string& user_dict_path) {
+    std::shared_ptr<DictImage> image(new DictImage);
+    uint64_t checksum = 0;
+    if (!image->Open(image_path) ||
+          !DictImage::SourceChecksum(ImageSources(dict_path, model_path, user_dict_path), &checksum) ||
+          checksum != image->SourceChecksum()) {
+      return std::shared_ptr<DictImage>();
+    }
+    return image;
+  }
+
   struct LocWord {
     string word;
     size_t begin;
@@ -37,6 +84,14 @@ class Jieba {
   void Cut(const string& sentence, vector<Word>& words, bool hmm = true) const {
     mix_seg_.Cut(sentence, words, hmm);
   }
+  // ctx holds the scratch buffers, one per thread (see SegmentContext)
+  void Cut(const string& sentence, vector<string>& words, bool hmm, SegmentContext& ctx) const {
+    mix_seg_.Cut(sentence, words, hmm, ctx);
+  }
+  // the words as byte ranges of sentence, nothing is copied
+  void Cut(const string& sentence, vector<WordSpan>& spans, bool hmm, SegmentContext& ctx) const {
+    mix_seg_.Cut(sentence, spans, hmm, ctx);
+  }
   void CutAll(const string& sentence, vector<string>& words) const {
     full_seg_.Cut(sentence, words);
   }
@@ -49,6 +104,12 @@ class Jieba {
   void CutForSearch(const string& sentence, vector<Word>& words, bool hmm = true) const {
     query_seg_.Cut(sentence, words, hmm);
   }
+  void CutForSearch(const string& sentence, vector<string>& words, bool hmm, SegmentContext& ctx) const {
+    query_seg_.Cut(sentence, words, hmm, ctx);
+  }
+  void CutForSearch(const string& sentence, vector<WordSpan>& spans, bool hmm, SegmentContext& ctx) const {
+    query_seg_.Cut(sentence, spans, hmm, ctx);
+  }
   void CutHMM(const string& sentence, vector<string>& words) const {
     hmm_seg_.Cut(sentence, words);
   }
@@ -115,6 +176,14 @@ class Jieba {
   }
 
  private:
+  static vector<string> ImageSources(const string& dict_path, const string& model_path, const string& user_dict_path) {
+    vector<string> paths;
+    paths.push_back(dict_path);
+    paths.push_back(model_path);
+    paths.push_back(user_dict_path);
+    return paths;
+  }
+
   DictTrie dict_trie_;
   HMMModel model_;
   
@@ -56,13 +56,20 @@ class MPSegment: public SegmentTagged {
            RuneStrArray::const_iterator end,
            vector<WordRange>& words,
            size_t max_word_len = MAX_WORD_LENGTH) const {
-    vector<Dag> dags;
+    SegmentContext ctx;
+    Cut(begin, end, words, ctx, max_word_len);
+  }
+  void Cut(RuneStrArray::const_iterator begin,
+           RuneStrArray::const_iterator end,
+           vector<WordRange>& words,
+           SegmentContext& ctx,
+           size_t max_word_len = MAX_WORD_LENGTH) const {
     dictTrie_->Find(begin, 
           end, 
-          dags,
+          ctx.dags,
           max_word_len);
-    CalcDP(dags);
-    CutByDag(begin, end, dags, words);
+    CalcDP(ctx.dags);
+    CutByDag(begin, end, ctx.dags, words);
   }
 
   const DictTrie* GetDictTrie() const {
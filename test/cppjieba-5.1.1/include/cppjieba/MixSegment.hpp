@@ -25,36 +25,48 @@ class MixSegment: public SegmentTagged {
     Cut(sentence, words, true);
   }
   void Cut(const string& sentence, vector<string>& words, bool hmm) const {
-    vector<Word> tmp;
-    Cut(sentence, tmp, hmm);
-    GetStringsFromWords(tmp, words);
+    SegmentContext ctx;
+    Cut(sentence, words, hmm, ctx);
+  }
+  void Cut(const string& sentence, vector<string>& words, bool hmm, SegmentContext& ctx) const {
+    CutSentence(sentence, hmm, ctx);
+    GetStringsFromWordRanges(sentence, ctx.words, words);
+  }
+  void Cut(const string& sentence, vector<WordSpan>& spans, bool hmm, SegmentContext& ctx) const {
+    CutSentence(sentence, hmm, ctx);
+    GetSpansFromWordRanges(ctx.words, spans);
   }
   void Cut(const string& sentence, vector<Word>& words, bool hmm = true) const {
-    PreFilter pre_filter(symbols_, sentence);
-    PreFilter::Range range;
-    vector<WordRange> wrs;
-    wrs.reserve(sentence.size() / 2);
-    while (pre_filter.HasNext()) {
-      range = pre_filter.Next();
-      Cut(range.begin, range.end, wrs, hmm);
-    }
+    SegmentContext ctx;
+    CutSentence(sentence, hmm, ctx);
     words.clear();
-    words.reserve(wrs.size());
-    GetWordsFromWordRanges(sentence, wrs, words);
+    words.reserve(ctx.words.size());
+    GetWordsFromWordRanges(sentence, ctx.words, words);
   }
 
   void Cut(RuneStrArray::const_iterator begin, RuneStrArray::const_iterator end, vector<WordRange>& res, bool hmm) const {
+    SegmentContext ctx;
+    Cut(begin, end, res, hmm, ctx);
+  }
+  void Cut(RuneStrArray::const_iterator begin, RuneStrArray::const_iterator end, vector<WordRange>& res, bool hmm, SegmentContext& ctx) const {
     if (!hmm) {
-      mpSeg_.Cut(begin, end, res);
+      mpSeg_.Cut(begin, end, res, ctx);
       return;
     }
-    vector<WordRange> words;
     assert(end >= begin);
-    words.reserve(end - begin);
-    mpSeg_.Cut(begin, end, words);
+    // An all-ASCII span (code, identifiers, English text) can't match any
+    // dictionary word, so the DAG would only yield single runes that all go to
+    // hmmSeg_, whose letter and number rules cut ASCII without running Viterbi.
+    if (begin != end && !mpSeg_.GetDictTrie()->HasAsciiWord() && WordRange(begin, end - 1).IsAllAscii()) {
+      hmmSeg_.Cut(begin, end, res, ctx);
+      return;
+    }
+    vector<WordRange>& words = ctx.mp_words;
+    words.clear();
+    mpSeg_.Cut(begin, end, words, ctx);
 
-    vector<WordRange> hmmRes;
-    hmmRes.reserve(end - begin);
+    vector<WordRange>& hmmRes = ctx.hmm_words;
+    hmmRes.clear();
     for (size_t i = 0; i < words.size(); i++) {
       //if mp Get a word, it's ok, put it into result
       if (words[i].left != words[i].right || (words[i].left == words[i].right && mpSeg_.IsUserDictSingleChineseWord(words[i].left->rune))) {
@@ -71,7 +83,7 @@ class MixSegment: public SegmentTagged {
       // Cut the sequence with hmm
       assert(j - 1 >= i);
       // TODO
-      hmmSeg_.Cut(words[i].left, words[j - 1].left + 1, hmmRes);
+      hmmSeg_.Cut(words[i].left, words[j - 1].left + 1, hmmRes, ctx);
       //put hmm result to result
       for (size_t k = 0; k < hmmRes.size(); k++) {
         res.push_back(hmmRes[k]);
@@ -98,6 +110,17 @@ class MixSegment: public SegmentTagged {
   }
 
  private:
+  // the words of the whole sentence into ctx.words
+  void CutSentence(const string& sentence, bool hmm, SegmentContext& ctx) const {
+    PreFilter pre_filter(symbols_, sentence, ctx.runes);
+    PreFilter::Range range;
+    ctx.words.clear();
+    while (pre_filter.HasNext()) {
+      range = pre_filter.Next();
+      Cut(range.begin, range.end, ctx.words, hmm, ctx);
+    }
+  }
+
   MPSegment mpSeg_;
   HMMSegment hmmSeg_;
   PosTagger tagger_;
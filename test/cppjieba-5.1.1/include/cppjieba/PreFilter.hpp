@@ -16,11 +16,15 @@ class PreFilter {
 
   PreFilter(const unordered_set<Rune>& symbols, 
         const string& sentence)
-    : symbols_(symbols) {
-    if (!DecodeRunesInString(sentence, sentence_)) {
-      XLOG(ERROR) << "decode failed. "; 
-    }
-    cursor_ = sentence_.begin();
+    : sentence_(local_), symbols_(symbols) {
+    Decode(sentence);
+  }
+  // decodes into the caller's buffer; the ranges point into it
+  PreFilter(const unordered_set<Rune>& symbols,
+        const string& sentence,
+        RuneStrArray& buffer)
+    : sentence_(buffer), symbols_(symbols) {
+    Decode(sentence);
   }
   ~PreFilter() {
   }
@@ -44,8 +48,16 @@ class PreFilter {
     return range;
   }
  private:
+  void Decode(const string& sentence) {
+    if (!DecodeRunesInString(sentence, sentence_)) {
+      XLOG(ERROR) << "decode failed. "; 
+    }
+    cursor_ = sentence_.begin();
+  }
+
   RuneStrArray::const_iterator cursor_;
-  RuneStrArray sentence_;
+  RuneStrArray local_;
+  RuneStrArray& sentence_;
   const unordered_set<Rune>& symbols_;
 }; // class PreFilter
 
@@ -28,30 +28,41 @@ class QuerySegment: public SegmentBase {
     Cut(sentence, words, true);
   }
   void Cut(const string& sentence, vector<string>& words, bool hmm) const {
-    vector<Word> tmp;
-    Cut(sentence, tmp, hmm);
-    GetStringsFromWords(tmp, words);
+    SegmentContext ctx;
+    Cut(sentence, words, hmm, ctx);
+  }
+  void Cut(const string& sentence, vector<string>& words, bool hmm, SegmentContext& ctx) const {
+    CutSentence(sentence, hmm, ctx);
+    GetStringsFromWordRanges(sentence, ctx.words, words);
+  }
+  void Cut(const string& sentence, vector<WordSpan>& spans, bool hmm, SegmentContext& ctx) const {
+    CutSentence(sentence, hmm, ctx);
+    GetSpansFromWordRanges(ctx.words, spans);
   }
   void Cut(const string& sentence, vector<Word>& words, bool hmm = true) const {
-    PreFilter pre_filter(symbols_, sentence);
-    PreFilter::Range range;
-    vector<WordRange> wrs;
-    wrs.reserve(sentence.size()/2);
-    while (pre_filter.HasNext()) {
-      range = pre_filter.Next();
-      Cut(range.begin, range.end, wrs, hmm);
-    }
+    SegmentContext ctx;
+    CutSentence(sentence, hmm, ctx);
     words.clear();
-    words.reserve(wrs.size());
-    GetWordsFromWordRanges(sentence, wrs, words);
+    words.reserve(ctx.words.size());
+    GetWordsFromWordRanges(sentence, ctx.words, words);
   }
   void Cut(RuneStrArray::const_iterator begin, RuneStrArray::const_iterator end, vector<WordRange>& res, bool hmm) const {
+    SegmentContext ctx;
+    Cut(begin, end, res, hmm, ctx);
+  }
+  void Cut(RuneStrArray::const_iterator begin, RuneStrArray::const_iterator end, vector<WordRange>& res, bool hmm, SegmentContext& ctx) const {
     //use mix Cut first
-    vector<WordRange> mixRes;
-    mixSeg_.Cut(begin, end, mixRes, hmm);
+    vector<WordRange>& mixRes = ctx.mix_words;
+    mixRes.clear();
+    mixSeg_.Cut(begin, end, mixRes, hmm, ctx);
 
-    vector<WordRange> fullRes;
+    // without ASCII words in the dictionary, no n-gram of an ASCII word is in it
+    bool skip_ascii = !trie_->HasAsciiWord();
     for (vector<WordRange>::const_iterator mixResItr = mixRes.begin(); mixResItr != mixRes.end(); mixResItr++) {
+      if (mixResItr->Length() > 2 && skip_ascii && mixResItr->IsAllAscii()) {
+        res.push_back(*mixResItr);
+        continue;
+      }
       if (mixResItr->Length() > 2) {
         for (size_t i = 0; i + 1 < mixResItr->Length(); i++) {
           WordRange wr(mixResItr->left + i, mixResItr->left + i + 1);
@@ -72,6 +83,16 @@ class QuerySegment: public SegmentBase {
     }
   }
  private:
+  // the words of the whole sentence into ctx.words
+  void CutSentence(const string& sentence, bool hmm, SegmentContext& ctx) const {
+    PreFilter pre_filter(symbols_, sentence, ctx.runes);
+    PreFilter::Range range;
+    ctx.words.clear();
+    while (pre_filter.HasNext()) {
+      range = pre_filter.Next();
+      Cut(range.begin, range.end, ctx.words, hmm, ctx);
+    }
+  }
   bool IsAllAscii(const Unicode& s) const {
    for(size_t i = 0; i < s.size(); i++) {
      if (s[i] >= 0x80) {
@@ -3,6 +3,7 @@
 
 #include "limonp/Logging.hpp"
 #include "PreFilter.hpp"
+#include "SegmentContext.hpp"
 #include <cassert>
 
 
@@ -0,0 +1,27 @@
+#ifndef CPPJIEBA_SEGMENT_CONTEXT_H
+#define CPPJIEBA_SEGMENT_CONTEXT_H
+
+#include "Trie.hpp"
+
+namespace cppjieba {
+
+// Scratch buffers for segmenting one sentence. The segmenters themselves are
+// const and can be shared by any number of threads; a thread that keeps its
+// own context (e.g. thread_local) and passes it to the Cut overloads taking
+// one reuses these buffers instead of allocating them on every call.
+// Each level of the segmentation has its own buffers, so nested calls never
+// share one.
+struct SegmentContext {
+  RuneStrArray runes;          // the decoded sentence, WordRanges point into it
+  vector<WordRange> words;     // the words of the whole sentence
+  vector<WordRange> mix_words; // QuerySegment: MixSegment's words of one range
+  vector<WordRange> mp_words;  // MixSegment: MPSegment's words of one range
+  vector<WordRange> hmm_words; // MixSegment: HMMSegment's words of a run of single runes
+  vector<Dag> dags;            // MPSegment
+  vector<size_t> status;       // HMMSegment::Viterbi
+  vector<uint8_t> path;
+}; // struct SegmentContext
+
+} // namespace cppjieba
+
+#endif // CPPJIEBA_SEGMENT_CONTEXT_H
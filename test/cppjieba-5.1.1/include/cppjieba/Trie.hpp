@@ -3,6 +3,8 @@
 
 #include <vector>
 #include <queue>
+#include <algorithm>
+#include <stdint.h>
 #include "limonp/StdExtension.hpp"
 #include "Unicode.hpp"
 
@@ -48,14 +50,40 @@ class TrieNode {
   const DictUnit *ptValue;
 };
 
+// One cell of the double array. Plain ints only, so the arrays can be
+// written to a dictionary image and used from mmap as they are.
+struct TrieUnit {
+  int32_t base;
+  int32_t check; // parent state, -1 when the cell is free
+  int32_t value; // 1 + index into the value table, 0 for none
+};
+
+// Double-array trie. The dictionary is frozen into two parallel int arrays
+// at construction: the child of state s on rune r is t = base[s] + code(r),
+// valid iff check[t] == s. Runes are remapped to dense codes, the most
+// frequent ones first, which keeps the arrays compact and each lookup a
+// couple of adjacent loads instead of a hash probe per rune.
+//
+// Words inserted later whose path already exists in the arrays just set the
+// value of that state; the rest go to a small pointer-based overlay trie
+// which Find only consults when it is not empty.
 class Trie {
  public:
   Trie(const vector<Unicode>& keys, const vector<const DictUnit*>& valuePointers)
-   : root_(new TrieNode) {
+   : overlay_(new TrieNode) {
     CreateTrie(keys, valuePointers);
   }
+  // use arrays saved by a previously built trie (see Units/Codes/WideCodes);
+  // they must stay valid and writable for the trie's lifetime
+  Trie(TrieUnit* units, size_t size,
+        const uint32_t* codes, size_t codes_size,
+        const vector<pair<Rune, uint32_t> >& wide_codes,
+        const vector<const DictUnit*>& valuePointers)
+   : units_(units), size_(size), codes_(codes), codes_size_(codes_size),
+     wide_codes_(wide_codes.begin(), wide_codes.end()), values_(valuePointers), overlay_(new TrieNode) {
+  }
   ~Trie() {
-    DeleteNode(root_);
+    DeleteNode(overlay_);
   }
 
   const DictUnit* Find(RuneStrArray::const_iterator begin, RuneStrArray::const_iterator end) const {
@@ -63,9 +91,23 @@ class Trie {
       return NULL;
     }
 
-    const TrieNode* ptNode = root_;
+    int32_t state = 0;
+    RuneStrArray::const_iterator it = begin;
+    for (; it != end; it++) {
+      if ((state = Child(state, it->rune)) < 0) {
+        break;
+      }
+    }
+    if (it == end) {
+      return Value(state);
+    }
+    if (NULL == overlay_->next) {
+      return NULL;
+    }
+
+    const TrieNode* ptNode = overlay_;
     TrieNode::NextMap::const_iterator citer;
-    for (RuneStrArray::const_iterator it = begin; it != end; it++) {
+    for (it = begin; it != end; it++) {
       if (NULL == ptNode->next) {
         return NULL;
       }
@@ -82,38 +124,28 @@ class Trie {
         RuneStrArray::const_iterator end, 
         vector<struct Dag>&res, 
         size_t max_word_len = MAX_WORD_LENGTH) const {
-    assert(root_ != NULL);
     res.resize(end - begin);
 
-    const TrieNode *ptNode = NULL;
-    TrieNode::NextMap::const_iterator citer;
-    for (size_t i = 0; i < size_t(end - begin); i++) {
+    const size_t len = end - begin;
+    const bool has_overlay = (NULL != overlay_->next);
+    for (size_t i = 0; i < len; i++) {
       res[i].runestr = *(begin + i);
+      res[i].nexts.clear(); // res may be reused
 
-      if (root_->next != NULL && root_->next->end() != (citer = root_->next->find(res[i].runestr.rune))) {
-        ptNode = citer->second;
-      } else {
-        ptNode = NULL;
-      }
-      if (ptNode != NULL) {
-        res[i].nexts.push_back(pair<size_t, const DictUnit*>(i, ptNode->ptValue));
-      } else {
-        res[i].nexts.push_back(pair<size_t, const DictUnit*>(i, static_cast<const DictUnit*>(NULL)));
-      }
+      int32_t state = Child(0, res[i].runestr.rune);
+      res[i].nexts.push_back(pair<size_t, const DictUnit*>(i, state < 0 ? NULL : Value(state)));
 
-      for (size_t j = i + 1; j < size_t(end - begin) && (j - i + 1) <= max_word_len; j++) {
-        if (ptNode == NULL || ptNode->next == NULL) {
+      for (size_t j = i + 1; state >= 0 && j < len && (j - i + 1) <= max_word_len; j++) {
+        if ((state = Child(state, (begin + j)->rune)) < 0) {
           break;
         }
-        citer = ptNode->next->find((begin + j)->rune);
-        if (ptNode->next->end() == citer) {
-          break;
-        }
-        ptNode = citer->second;
-        if (NULL != ptNode->ptValue) {
-          res[i].nexts.push_back(pair<size_t, const DictUnit*>(j, ptNode->ptValue));
+        if (0 != units_[state].value) {
+          res[i].nexts.push_back(pair<size_t, const DictUnit*>(j, Value(state)));
         }
       }
+      if (has_overlay) {
+        FindOverlay(begin, end, i, res[i], max_word_len);
+      }
     }
   }
 
@@ -122,8 +154,15 @@ class Trie {
       return;
     }
 
+    int32_t state = FindState(key);
+    if (state >= 0) {
+      values_.push_back(ptValue);
+      units_[state].value = int32_t(values_.size());
+      return;
+    }
+
     TrieNode::NextMap::const_iterator kmIter;
-    TrieNode *ptNode = root_;
+    TrieNode *ptNode = overlay_;
     for (Unicode::const_iterator citer = key.begin(); citer != key.end(); ++citer) {
       if (NULL == ptNode->next) {
         ptNode->next = new TrieNode::NextMap;
@@ -141,45 +180,322 @@ class Trie {
     assert(ptNode != NULL);
     ptNode->ptValue = ptValue;
   }
+
+  // 只删除key这一个词，以它为前缀的其它词不受影响
   void DeleteNode(const Unicode& key, const DictUnit* ptValue) {
-      if (key.begin() == key.end()) {
+    if (key.begin() == key.end()) {
+      return;
+    }
+
+    int32_t state = FindState(key);
+    if (state >= 0) {
+      units_[state].value = 0;
+      return;
+    }
+
+    TrieNode *ptNode = overlay_;
+    for (Unicode::const_iterator citer = key.begin(); citer != key.end(); ++citer) {
+      if (NULL == ptNode->next) {
         return;
       }
-      //定义一个NextMap迭代器
-      TrieNode::NextMap::const_iterator kmIter;
-      //定义一个指向root的TrieNode指针
-      TrieNode *ptNode = root_;
-      for (Unicode::const_iterator citer = key.begin(); citer != key.end(); ++citer) {
-        //链表不存在元素
-        if (NULL == ptNode->next) {
-          return;
-        }
-        kmIter = ptNode->next->find(*citer);
-        //如果map中不存在,跳出循环
-        if (ptNode->next->end() == kmIter) {
-              break;
-        }
-        //从unordered_map中擦除该项
-        ptNode->next->erase(*citer);
-        //删除该node
-        ptNode = kmIter->second;
-        delete ptNode;
-        break;
+      TrieNode::NextMap::const_iterator kmIter = ptNode->next->find(*citer);
+      if (ptNode->next->end() == kmIter) {
+        return;
       }
-      return;
- }
+      ptNode = kmIter->second;
+    }
+    ptNode->ptValue = NULL;
+  }
+
+  // the arrays, for saving to a dictionary image. Values index the
+  // valuePointers the trie was built with, so save it before any InsertNode.
+  const TrieUnit* Units() const {
+    return units_;
+  }
+  size_t Size() const {
+    return size_;
+  }
+  const uint32_t* Codes() const {
+    return codes_;
+  }
+  size_t CodesSize() const {
+    return codes_size_;
+  }
+  vector<pair<Rune, uint32_t> > WideCodes() const {
+    vector<pair<Rune, uint32_t> > res(wide_codes_.begin(), wide_codes_.end());
+    sort(res.begin(), res.end());
+    return res;
+  }
+
  private:
-  void CreateTrie(const vector<Unicode>& keys, const vector<const DictUnit*>& valuePointers) {
-    if (valuePointers.empty() || keys.empty()) {
+  const DictUnit* Value(int32_t state) const {
+    int32_t value = units_[state].value;
+    return 0 == value ? NULL : values_[value - 1];
+  }
+
+  // 0 for runes that never appear in the dictionary
+  uint32_t Code(Rune rune) const {
+    if (rune < codes_size_) {
+      return codes_[rune];
+    }
+    unordered_map<Rune, uint32_t>::const_iterator it = wide_codes_.find(rune);
+    return it == wide_codes_.end() ? 0 : it->second;
+  }
+
+  int32_t Child(int32_t state, Rune rune) const {
+    uint32_t code = Code(rune);
+    if (0 == code) {
+      return -1;
+    }
+    size_t t = size_t(units_[state].base) + code;
+    if (t >= size_ || units_[t].check != state) {
+      return -1;
+    }
+    return int32_t(t);
+  }
+
+  int32_t FindState(const Unicode& key) const {
+    int32_t state = 0;
+    for (Unicode::const_iterator citer = key.begin(); citer != key.end() && state >= 0; ++citer) {
+      state = Child(state, *citer);
+    }
+    return state;
+  }
+
+  // append words starting at i found in the overlay to dag.nexts. An overlay
+  // word is only there because its path is missing from the double array, so
+  // it is longer than every word the array matched at i and the order holds.
+  void FindOverlay(RuneStrArray::const_iterator begin,
+        RuneStrArray::const_iterator end,
+        size_t i,
+        Dag& dag,
+        size_t max_word_len) const {
+    const TrieNode* ptNode = overlay_;
+    TrieNode::NextMap::const_iterator citer;
+    for (size_t j = i; j < size_t(end - begin) && (j - i + 1) <= max_word_len; j++) {
+      if (NULL == ptNode->next || ptNode->next->end() == (citer = ptNode->next->find((begin + j)->rune))) {
+        return;
+      }
+      ptNode = citer->second;
+      if (NULL == ptNode->ptValue) {
+        continue;
+      }
+      if (j == i) {
+        dag.nexts[0].second = ptNode->ptValue;
+        continue;
+      }
+      dag.nexts.push_back(pair<size_t, const DictUnit*>(j, ptNode->ptValue));
+    }
+  }
+
+  // free cells are kept in a doubly linked list while building, so finding a
+  // base for a node skips the occupied part of the array. A cell that failed
+  // as a candidate too many times is dropped from the list (it stays free and
+  // can still be taken as a child slot), otherwise crowded cells near the head
+  // get retried for every node.
+  static const uint8_t MAX_TRIALS = 8;
+  struct FreeList {
+    vector<int32_t> next;
+    vector<int32_t> prev;
+    vector<uint8_t> trials; // MAX_TRIALS once the cell is out of the list
+    int32_t head;
+    int32_t tail;
+    FreeList(): head(-1), tail(-1) {
+    }
+  };
+
+  void Grow(size_t size, FreeList& free_list) {
+    size_t old_size = own_units_.size();
+    if (size <= old_size) {
       return;
     }
+    TrieUnit free_unit = {0, -1, 0};
+    own_units_.resize(size, free_unit);
+    free_list.next.resize(size, -1);
+    free_list.prev.resize(size, -1);
+    free_list.trials.resize(size, 0);
+    for (size_t i = old_size; i < size; i++) {
+      free_list.prev[i] = free_list.tail;
+      if (free_list.tail >= 0) {
+        free_list.next[free_list.tail] = int32_t(i);
+      } else {
+        free_list.head = int32_t(i);
+      }
+      free_list.tail = int32_t(i);
+    }
+  }
+
+  void Use(int32_t cell, int32_t parent, FreeList& free_list) {
+    own_units_[cell].check = parent;
+    if (free_list.trials[cell] < MAX_TRIALS) {
+      Unlink(cell, free_list);
+    }
+  }
+
+  void Unlink(int32_t cell, FreeList& free_list) {
+    free_list.trials[cell] = MAX_TRIALS;
+    int32_t prev = free_list.prev[cell], next = free_list.next[cell];
+    if (prev >= 0) {
+      free_list.next[prev] = next;
+    } else {
+      free_list.head = next;
+    }
+    if (next >= 0) {
+      free_list.prev[next] = prev;
+    } else {
+      free_list.tail = prev;
+    }
+  }
+
+  // smallest base (from the free list) such that base + code is free for every code
+  int32_t FindBase(const vector<uint32_t>& codes, FreeList& free_list) {
+    const uint32_t first = codes[0], last = codes.back();
+    for (int32_t cell = free_list.head, next; ; cell = next) {
+      if (cell < 0) {
+        // every free cell was tried, the new base starts right after the array
+        cell = int32_t(own_units_.size());
+        Grow(own_units_.size() + last + 1, free_list);
+      }
+      next = free_list.next[cell];
+      if (uint32_t(cell) <= first) {
+        continue;
+      }
+      int32_t base = cell - int32_t(first);
+      Grow(size_t(base) + last + 1, free_list);
+      next = free_list.next[cell]; // Grow may have linked new cells after the tail
+      bool ok = true;
+      for (size_t k = 1; k < codes.size() && ok; k++) {
+        ok = own_units_[base + codes[k]].check < 0;
+      }
+      if (ok) {
+        return base;
+      }
+      if (++free_list.trials[cell] >= MAX_TRIALS) {
+        Unlink(cell, free_list);
+      }
+    }
+  }
+
+  void CreateTrie(const vector<Unicode>& keys, const vector<const DictUnit*>& valuePointers) {
     assert(keys.size() == valuePointers.size());
+    own_units_.clear();
+    own_codes_.clear();
+    wide_codes_.clear();
+    values_ = valuePointers;
 
+    // 1. remap runes to dense codes, most frequent first
+    unordered_map<Rune, size_t> freq;
     for (size_t i = 0; i < keys.size(); i++) {
-      InsertNode(keys[i], valuePointers[i]);
+      for (size_t j = 0; j < keys[i].size(); j++) {
+        freq[keys[i][j]]++;
+      }
+    }
+    vector<pair<size_t, Rune> > order;
+    order.reserve(freq.size());
+    Rune max_rune = 0;
+    for (unordered_map<Rune, size_t>::const_iterator it = freq.begin(); it != freq.end(); ++it) {
+      order.push_back(make_pair(it->second, it->first));
+      if (it->first < 0x10000 && it->first > max_rune) {
+        max_rune = it->first;
+      }
+    }
+    sort(order.begin(), order.end(), CodeOrder);
+    own_codes_.assign(freq.empty() ? 0 : max_rune + 1, 0);
+    codes_ = own_codes_.data();
+    codes_size_ = own_codes_.size();
+    for (size_t i = 0; i < order.size(); i++) {
+      if (order[i].second < own_codes_.size()) {
+        own_codes_[order[i].second] = uint32_t(i + 1);
+      } else {
+        wide_codes_[order[i].second] = uint32_t(i + 1);
+      }
+    }
+
+    // 2. encode and sort the keys; for duplicated keys the later value wins
+    vector<uint32_t> encoded;
+    vector<size_t> offsets(1, 0);
+    for (size_t i = 0; i < keys.size(); i++) {
+      for (size_t j = 0; j < keys[i].size(); j++) {
+        encoded.push_back(Code(keys[i][j]));
+      }
+      offsets.push_back(encoded.size());
+    }
+    vector<size_t> ids;
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (offsets[i + 1] > offsets[i]) {
+        ids.push_back(i);
+      }
     }
+    stable_sort(ids.begin(), ids.end(), KeyLess(encoded, offsets));
+
+    // 3. place the nodes breadth first
+    FreeList free_list;
+    Grow(order.size() + 2, free_list);
+    Use(0, 0, free_list);
+    struct Range {
+      int32_t state;
+      size_t lo, hi, depth;
+    };
+    vector<Range> queue;
+    if (!ids.empty()) {
+      Range root = {0, 0, ids.size(), 0};
+      queue.push_back(root);
+    }
+    vector<uint32_t> codes;
+    vector<size_t> starts;
+    for (size_t q = 0; q < queue.size(); q++) {
+      const Range r = queue[q];
+      size_t i = r.lo;
+      for (; i < r.hi && offsets[ids[i] + 1] - offsets[ids[i]] == r.depth; i++) {
+        own_units_[r.state].value = int32_t(ids[i] + 1);
+      }
+      codes.clear();
+      starts.clear();
+      for (; i < r.hi; i++) {
+        uint32_t code = encoded[offsets[ids[i]] + r.depth];
+        if (codes.empty() || codes.back() != code) {
+          codes.push_back(code);
+          starts.push_back(i);
+        }
+      }
+      if (codes.empty()) {
+        continue;
+      }
+      starts.push_back(r.hi);
+      int32_t base = FindBase(codes, free_list);
+      own_units_[r.state].base = base;
+      for (size_t k = 0; k < codes.size(); k++) {
+        Range child = {base + int32_t(codes[k]), starts[k], starts[k + 1], r.depth + 1};
+        Use(child.state, r.state, free_list);
+        queue.push_back(child);
+      }
+    }
+
+    // trim unused cells at the end
+    size_t size = own_units_.size();
+    while (size > 1 && own_units_[size - 1].check < 0) {
+      size--;
+    }
+    vector<TrieUnit>(own_units_.begin(), own_units_.begin() + size).swap(own_units_);
+    units_ = own_units_.data();
+    size_ = own_units_.size();
+  }
+
+  static bool CodeOrder(const pair<size_t, Rune>& lhs, const pair<size_t, Rune>& rhs) {
+    return lhs.first != rhs.first ? lhs.first > rhs.first : lhs.second < rhs.second;
   }
 
+  struct KeyLess {
+    const vector<uint32_t>& encoded;
+    const vector<size_t>& offsets;
+    KeyLess(const vector<uint32_t>& e, const vector<size_t>& o): encoded(e), offsets(o) {
+    }
+    bool operator()(size_t lhs, size_t rhs) const {
+      return lexicographical_compare(encoded.begin() + offsets[lhs], encoded.begin() + offsets[lhs + 1],
+            encoded.begin() + offsets[rhs], encoded.begin() + offsets[rhs + 1]);
+    }
+  };
+
   void DeleteNode(TrieNode* node) {
     if (NULL == node) {
       return;
@@ -193,7 +509,15 @@ class Trie {
     delete node;
   }
 
-  TrieNode* root_;
+  TrieUnit* units_; // own_units_ or an image's array
+  size_t size_;
+  const uint32_t* codes_; // BMP rune -> code
+  size_t codes_size_;
+  unordered_map<Rune, uint32_t> wide_codes_; // runes outside the BMP
+  vector<const DictUnit*> values_;
+  vector<TrieUnit> own_units_;
+  vector<uint32_t> own_codes_;
+  TrieNode* overlay_;
 }; // class Trie
 } // namespace cppjieba
 
@@ -3,10 +3,14 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <string>
 #include <vector>
 #include <ostream>
 #include "limonp/LocalVector.hpp"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace cppjieba {
 
@@ -75,6 +79,17 @@ struct WordRange {
   }
 }; // struct WordRange
 
+// a word as the byte range [offset, offset + len) of the sentence it was cut
+// from, for callers that want views into their own buffer instead of copies
+struct WordSpan {
+  uint32_t offset;
+  uint32_t len;
+  WordSpan(): offset(0), len(0) {
+  }
+  WordSpan(uint32_t o, uint32_t l): offset(o), len(l) {
+  }
+}; // struct WordSpan
+
 struct RuneStrLite {
   uint32_t rune;
   uint32_t len;
@@ -84,65 +99,109 @@ struct RuneStrLite {
   }
 }; // struct RuneStrLite
 
+// Decodes one UTF-8 sequence as RFC 3629 defines it: continuation bytes must
+// be 10xxxxxx, and overlong forms, surrogates and runes above U+10FFFF are
+// rejected. Returns len 0 for an invalid or truncated sequence.
 inline RuneStrLite DecodeRuneInString(const char* str, size_t len) {
   RuneStrLite rp(0, 0);
   if (str == NULL || len == 0) {
     return rp;
   }
-  if (!(str[0] & 0x80)) { // 0xxxxxxx
-    // 7bit, total 7bit
-    rp.rune = (uint8_t)(str[0]) & 0x7f;
+  const uint8_t* s = reinterpret_cast<const uint8_t*>(str);
+  if (s[0] < 0x80) { // 0xxxxxxx
+    rp.rune = s[0];
     rp.len = 1;
-  } else if ((uint8_t)str[0] <= 0xdf &&  1 < len) { 
-    // 110xxxxxx
-    // 5bit, total 5bit
-    rp.rune = (uint8_t)(str[0]) & 0x1f;
-
-    // 6bit, total 11bit
-    rp.rune <<= 6;
-    rp.rune |= (uint8_t)(str[1]) & 0x3f;
+    return rp;
+  }
+  // the bounds of the second byte depend on the first one, the rest are 80..bf
+  uint8_t lo = 0x80, hi = 0xbf;
+  if (s[0] >= 0xc2 && s[0] <= 0xdf) { // 110xxxxx
+    rp.rune = s[0] & 0x1f;
     rp.len = 2;
-  } else if((uint8_t)str[0] <= 0xef && 2 < len) { // 1110xxxxxx
-    // 4bit, total 4bit
-    rp.rune = (uint8_t)(str[0]) & 0x0f;
-
-    // 6bit, total 10bit
-    rp.rune <<= 6;
-    rp.rune |= (uint8_t)(str[1]) & 0x3f;
-
-    // 6bit, total 16bit
-    rp.rune <<= 6;
-    rp.rune |= (uint8_t)(str[2]) & 0x3f;
-
+  } else if (s[0] >= 0xe0 && s[0] <= 0xef) { // 1110xxxx
+    if (s[0] == 0xe0) {
+      lo = 0xa0; // overlong
+    } else if (s[0] == 0xed) {
+      hi = 0x9f; // surrogates
+    }
+    rp.rune = s[0] & 0x0f;
     rp.len = 3;
-  } else if((uint8_t)str[0] <= 0xf7 && 3 < len) { // 11110xxxx
-    // 3bit, total 3bit
-    rp.rune = (uint8_t)(str[0]) & 0x07;
-
-    // 6bit, total 9bit
-    rp.rune <<= 6;
-    rp.rune |= (uint8_t)(str[1]) & 0x3f;
-
-    // 6bit, total 15bit
-    rp.rune <<= 6;
-    rp.rune |= (uint8_t)(str[2]) & 0x3f;
-
-    // 6bit, total 21bit
-    rp.rune <<= 6;
-    rp.rune |= (uint8_t)(str[3]) & 0x3f;
-
+  } else if (s[0] >= 0xf0 && s[0] <= 0xf4) { // 11110xxx
+    if (s[0] == 0xf0) {
+      lo = 0x90; // overlong
+    } else if (s[0] == 0xf4) {
+      hi = 0x8f; // above U+10FFFF
+    }
+    rp.rune = s[0] & 0x07;
     rp.len = 4;
-  } else {
-    rp.rune = 0;
-    rp.len = 0;
+  } else { // stray continuation byte, c0/c1 or f5..ff
+    return RuneStrLite(0, 0);
+  }
+  if (len < rp.len || s[1] < lo || s[1] > hi) {
+    return RuneStrLite(0, 0);
+  }
+  for (uint32_t i = 1; i < rp.len; i++) {
+    if (i > 1 && (s[i] & 0xc0) != 0x80) {
+      return RuneStrLite(0, 0);
+    }
+    rp.rune = (rp.rune << 6) | (s[i] & 0x3f);
   }
   return rp;
 }
 
+// number of leading ASCII bytes of s
+inline size_t AsciiPrefixLength(const char* s, size_t len) {
+  size_t i = 0;
+#ifdef __SSE2__
+  for (; i + 16 <= len; i += 16) {
+    int mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i)));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+#else
+  for (; i + 8 <= len; i += 8) {
+    uint64_t word;
+    memcpy(&word, s + i, 8);
+    if (word & 0x8080808080808080ULL) {
+      break;
+    }
+  }
+#endif
+  while (i < len && !(s[i] & 0x80)) {
+    i++;
+  }
+  return i;
+}
+
+// number of runes in valid UTF-8, i.e. the bytes that are not 10xxxxxx
+inline size_t CountRunes(const char* s, size_t len) {
+  size_t continuations = 0, i = 0;
+#ifdef __SSE2__
+  const __m128i bound = _mm_set1_epi8(-64); // 0xc0 as signed, continuation bytes are below it
+  for (; i + 16 <= len; i += 16) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+    continuations += __builtin_popcount(_mm_movemask_epi8(_mm_cmplt_epi8(x, bound)));
+  }
+#endif
+  for (; i < len; i++) {
+    continuations += ((uint8_t)s[i] & 0xc0) == 0x80;
+  }
+  return len - continuations;
+}
+
+// Runs of ASCII, which is most of what the search engine indexes, are found a
+// block at a time and emitted without going through DecodeRuneInString.
 inline bool DecodeRunesInString(const char* s, size_t len, RuneStrArray& runes) {
   runes.clear();
-  runes.reserve(len / 2);
+  runes.reserve(CountRunes(s, len));
   for (uint32_t i = 0, j = 0; i < len;) {
+    if (!(s[i] & 0x80)) {
+      for (uint32_t end = i + AsciiPrefixLength(s + i, len - i); i < end; i++, j++) {
+        runes.push_back(RuneStr((uint8_t)s[i], i, 1, j, 1));
+      }
+      continue;
+    }
     RuneStrLite rp = DecodeRuneInString(s + i, len - i);
     if (rp.len == 0) {
       runes.clear();
@@ -215,6 +274,22 @@ inline vector<Word> GetWordsFromWordRanges(const string& s, const vector<WordRan
   return result;
 }
 
+inline void GetStringsFromWordRanges(const string& s, const vector<WordRange>& wrs, vector<string>& strs) {
+  strs.resize(wrs.size());
+  for (size_t i = 0; i < wrs.size(); i++) {
+    uint32_t len = wrs[i].right->offset - wrs[i].left->offset + wrs[i].right->len;
+    strs[i].assign(s, wrs[i].left->offset, len);
+  }
+}
+
+inline void GetSpansFromWordRanges(const vector<WordRange>& wrs, vector<WordSpan>& spans) {
+  spans.resize(wrs.size());
+  for (size_t i = 0; i < wrs.size(); i++) {
+    spans[i].offset = wrs[i].left->offset;
+    spans[i].len = wrs[i].right->offset - wrs[i].left->offset + wrs[i].right->len;
+  }
+}
+
 inline void GetStringsFromWords(const vector<Word>& words, vector<string>& strs) {
   strs.resize(words.size());
   for (size_t i = 0; i < words.size(); ++i) {
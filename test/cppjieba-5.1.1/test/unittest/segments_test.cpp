@@ -48,6 +48,22 @@ TEST(MixSegmentTest, Test1) {
   }
 }
 
+TEST(MixSegmentTest, AsciiSpan) {
+  MixSegment segment("../test/testdata/extra_dict/jieba.dict.small.utf8", "../dict/hmm_model.utf8");
+  vector<string> words;
+  ASSERT_FALSE(segment.GetDictTrie()->HasAsciiWord());
+  segment.Cut("boost::asio::ip::tcp v1.2", words);
+  ASSERT_EQ("boost/:/:/asio/:/:/ip/:/:/tcp/ /v1/./2", Join(words.begin(), words.end(), "/"));
+  segment.Cut("用boost::asio", words);
+  ASSERT_EQ("用/boost/:/:/asio", Join(words.begin(), words.end(), "/"));
+
+  // an ASCII word in the dictionary turns the shortcut off
+  ASSERT_TRUE(const_cast<DictTrie*>(segment.GetDictTrie())->InsertUserWord("::"));
+  ASSERT_TRUE(segment.GetDictTrie()->HasAsciiWord());
+  segment.Cut("boost::asio::ip::tcp v1.2", words);
+  ASSERT_EQ("boost/::/asio/::/ip/::/tcp/ /v1/./2", Join(words.begin(), words.end(), "/"));
+}
+
 TEST(MixSegmentTest, NoUserDict) {
   MixSegment segment("../test/testdata/extra_dict/jieba.dict.small.utf8", "../dict/hmm_model.utf8");
   const char* str = "令狐冲是云计算方面的专家";
@@ -217,6 +233,32 @@ TEST(QuerySegment, Test1) {
   ASSERT_EQ(s1, s2);
 }
 
+TEST(QuerySegment, Context) {
+  QuerySegment segment("../test/testdata/extra_dict/jieba.dict.small.utf8", "../dict/hmm_model.utf8", "../test/testdata/userdict.utf8");
+  const char* sentences[] = {
+    "小明硕士毕业于中国科学院计算所，后在日本京都大学深造",
+    "",
+    "他来到了网易杭研大厦 boost::asio 3.14",
+    "令狐冲是云计算方面的专家",
+  };
+  // one context reused for every sentence gives the same words as a fresh one each time
+  SegmentContext ctx;
+  for (size_t round = 0; round < 2; round++) {
+    for (size_t i = 0; i < sizeof(sentences) / sizeof(sentences[0]); i++) {
+      vector<string> expected, actual;
+      segment.Cut(sentences[i], expected, true);
+      segment.Cut(sentences[i], actual, true, ctx);
+      ASSERT_EQ(expected, actual) << sentences[i];
+      vector<WordSpan> spans;
+      segment.Cut(sentences[i], spans, true, ctx);
+      ASSERT_EQ(expected.size(), spans.size());
+      for (size_t j = 0; j < spans.size(); j++) {
+        ASSERT_EQ(expected[j], string(sentences[i] + spans[j].offset, spans[j].len));
+      }
+    }
+  }
+}
+
 TEST(QuerySegment, Test2) {
   QuerySegment segment("../test/testdata/extra_dict/jieba.dict.small.utf8", "../dict/hmm_model.utf8", "../test/testdata/userdict.utf8|../test/testdata/userdict.english");
   vector<string> words;
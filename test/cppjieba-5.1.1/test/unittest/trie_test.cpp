@@ -1,5 +1,6 @@
 #include "cppjieba/DictTrie.hpp"
 #include "cppjieba/MPSegment.hpp"
+#include "cppjieba/HMMModel.hpp"
 #include "gtest/gtest.h"
 
 using namespace cppjieba;
@@ -175,3 +176,85 @@ TEST(DictTrieTest, Dag) {
     }
   }
 }
+
+TEST(DictTrieTest, InsertAndDeleteUserWord) {
+  DictTrie trie(DICT_FILE);
+  cppjieba::RuneStrArray unicode;
+
+  // path already in the double array: only the value changes
+  ASSERT_TRUE(DecodeRunesInString("清华大", unicode));
+  ASSERT_TRUE(trie.Find(unicode.begin(), unicode.end()) == NULL);
+  ASSERT_TRUE(trie.InsertUserWord("清华大"));
+  ASSERT_TRUE(trie.Find(unicode.begin(), unicode.end()) != NULL);
+
+  // new path: goes to the overlay and shows up in the dag after 清华 and 清华园
+  ASSERT_TRUE(trie.InsertUserWord("清华园丁"));
+  ASSERT_TRUE(DecodeRunesInString("清华园丁", unicode));
+  ASSERT_TRUE(trie.Find(unicode.begin(), unicode.end()) != NULL);
+  vector<struct Dag> res;
+  trie.Find(unicode.begin(), unicode.end(), res);
+  ASSERT_EQ(4u, res.size());
+  ASSERT_EQ(4u, res[0].nexts.size());
+  for (size_t i = 0; i < res[0].nexts.size(); i++) {
+    ASSERT_EQ(i, res[0].nexts[i].first);
+  }
+
+  // deleting a word keeps the longer words sharing its prefix
+  ASSERT_TRUE(trie.DeleteUserWord("清华"));
+  ASSERT_TRUE(DecodeRunesInString("清华", unicode));
+  ASSERT_TRUE(trie.Find(unicode.begin(), unicode.end()) == NULL);
+  ASSERT_TRUE(DecodeRunesInString("清华大学", unicode));
+  ASSERT_TRUE(trie.Find(unicode.begin(), unicode.end()) != NULL);
+  ASSERT_TRUE(trie.DeleteUserWord("清华园丁"));
+  ASSERT_TRUE(DecodeRunesInString("清华园丁", unicode));
+  ASSERT_TRUE(trie.Find(unicode.begin(), unicode.end()) == NULL);
+}
+
+TEST(DictTrieTest, Image) {
+  DictTrie trie(DICT_FILE, "../test/testdata/userdict.utf8");
+  HMMModel model("../dict/hmm_model.utf8");
+  DictImageWriter writer;
+  trie.Save(writer);
+  model.Save(writer);
+  const char* const image_path = "dict_trie_test.img";
+  ASSERT_TRUE(writer.Write(image_path, 12345));
+
+  std::shared_ptr<DictImage> image(new DictImage);
+  ASSERT_TRUE(image->Open(image_path));
+  unlink(image_path);
+  ASSERT_EQ(12345u, image->SourceChecksum());
+  DictTrie loaded(image);
+  HMMModel loaded_model(*image);
+
+  ASSERT_EQ(trie.GetMinWeight(), loaded.GetMinWeight());
+  const char * words[] = {"来到", "清华大学", "云计算", "蓝翔", "区块链"};
+  cppjieba::RuneStrArray unicode;
+  for (size_t i = 0; i < sizeof(words)/sizeof(words[0]); i++) {
+    ASSERT_TRUE(DecodeRunesInString(words[i], unicode));
+    const DictUnit* expected = trie.Find(unicode.begin(), unicode.end());
+    const DictUnit* actual = loaded.Find(unicode.begin(), unicode.end());
+    ASSERT_TRUE(expected != NULL && actual != NULL);
+    ASSERT_EQ(expected->weight, actual->weight);
+    ASSERT_EQ(expected->tag, actual->tag);
+  }
+  ASSERT_TRUE(DecodeRunesInString("北京邮电大学", unicode));
+  vector<struct Dag> expected_dags, dags;
+  trie.Find(unicode.begin(), unicode.end(), expected_dags);
+  loaded.Find(unicode.begin(), unicode.end(), dags);
+  ASSERT_EQ(expected_dags.size(), dags.size());
+  for (size_t i = 0; i < dags.size(); i++) {
+    ASSERT_EQ(expected_dags[i].nexts.size(), dags[i].nexts.size());
+  }
+
+  // inserting into a loaded trie writes to the private mapping only
+  ASSERT_TRUE(loaded.InsertUserWord("清华大"));
+  ASSERT_TRUE(DecodeRunesInString("清华大", unicode));
+  ASSERT_TRUE(loaded.Find(unicode.begin(), unicode.end()) != NULL);
+
+  ASSERT_EQ(0, memcmp(model.transProb, loaded_model.transProb, sizeof(model.transProb)));
+  for (size_t i = 0; i < HMMModel::STATUS_SUM; i++) {
+    ASSERT_EQ(model.startProb[i], loaded_model.startProb[i]);
+    ASSERT_EQ(model.emitProbVec[i]->size(), loaded_model.emitProbVec[i]->size());
+  }
+  ASSERT_EQ(model.GetEmitProb(&model.emitProbB, 0x4e2d, 0.0), loaded_model.GetEmitProb(&loaded_model.emitProbB, 0x4e2d, 0.0));
+}
@@ -25,6 +25,51 @@ TEST(UnicodeTest, Illegal) {
   ASSERT_EQ(expected, actual);
 }
 
+TEST(UnicodeTest, Validate) {
+  const char* bad[] = {
+    "\xc0\xaf",         // overlong '/'
+    "\xe0\x80\xaf",     // overlong '/'
+    "\xf0\x80\x80\xaf", // overlong '/'
+    "\xed\xa0\x80",     // surrogate
+    "\xf4\x90\x80\x80", // above U+10FFFF
+    "\xf8\x88\x80\x80\x80",
+    "\xe4\xbd",         // truncated
+    "\xe4\x41\xa0",     // bad continuation byte
+    "\xe4\xbd\x41",
+  };
+  for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+    RuneStrArray runes;
+    ASSERT_FALSE(DecodeRunesInString(string("abc") + bad[i], runes)) << i;
+    ASSERT_TRUE(runes.empty());
+  }
+  Unicode unicode;
+  ASSERT_TRUE(DecodeRunesInString("\xc2\x80\xed\x9f\xbf\xee\x80\x80\xf0\x90\x80\x80\xf4\x8f\xbf\xbf", unicode));
+  string actual;
+  ASSERT_EQ("[\"128\", \"55295\", \"57344\", \"65536\", \"1114111\"]", actual << unicode);
+}
+
+TEST(UnicodeTest, AsciiRuns) {
+  // ASCII runs of every length around the 16-byte blocks, between multi-byte runes
+  string s;
+  for (size_t n = 0; n < 40; n++) {
+    s += string(n, 'a' + n % 26);
+    s += (n % 2) ? "\xe4\xbd\xa0" : "\xf0\x9f\x98\x80";
+  }
+  RuneStrArray runes;
+  ASSERT_TRUE(DecodeRunesInString(s, runes));
+  uint32_t offset = 0;
+  for (size_t i = 0; i < runes.size(); i++) {
+    RuneStrLite rp = DecodeRuneInString(s.data() + offset, s.size() - offset);
+    ASSERT_EQ(rp.rune, runes[i].rune);
+    ASSERT_EQ(rp.len, runes[i].len);
+    ASSERT_EQ(offset, runes[i].offset);
+    ASSERT_EQ(i, runes[i].unicode_offset);
+    offset += rp.len;
+  }
+  ASSERT_EQ(s.size(), offset);
+  ASSERT_EQ(CountRunes(s.data(), s.size()), runes.size());
+}
+
 TEST(UnicodeTest, Rand) {
   const size_t ITERATION = 1024;
   const size_t MAX_LEN = 256;
@@ -0,0 +1,130 @@
+#include <iostream>
+#include <ctime>
+#include <fstream>
+#include "cppjieba/DictTrie.hpp"
+#include "cppjieba/HMMSegment.hpp"
+#include "limonp/Colors.hpp"
+
+using namespace cppjieba;
+
+// HMMSegment::Viterbi as it was before the float tables: double weights,
+// X*4 weight and path matrices, four emit lookups per rune.
+void ReferenceViterbi(const HMMModel& model,
+      RuneStrArray::const_iterator begin,
+      RuneStrArray::const_iterator end,
+      vector<size_t>& status) {
+  size_t Y = HMMModel::STATUS_SUM;
+  size_t X = end - begin;
+  vector<int> path(X * Y);
+  vector<double> weight(X * Y);
+
+  for (size_t y = 0; y < Y; y++) {
+    weight[0 + y * X] = model.startProb[y] + model.GetEmitProb(model.emitProbVec[y], begin->rune, MIN_DOUBLE);
+    path[0 + y * X] = -1;
+  }
+  for (size_t x = 1; x < X; x++) {
+    for (size_t y = 0; y < Y; y++) {
+      size_t now = x + y * X;
+      weight[now] = MIN_DOUBLE;
+      path[now] = HMMModel::E;
+      double emitProb = model.GetEmitProb(model.emitProbVec[y], (begin + x)->rune, MIN_DOUBLE);
+      for (size_t preY = 0; preY < Y; preY++) {
+        double tmp = weight[x - 1 + preY * X] + model.transProb[preY][y] + emitProb;
+        if (tmp > weight[now]) {
+          weight[now] = tmp;
+          path[now] = preY;
+        }
+      }
+    }
+  }
+  size_t stat = weight[X - 1 + HMMModel::E * X] >= weight[X - 1 + HMMModel::S * X] ? HMMModel::E : HMMModel::S;
+  status.resize(X);
+  for (int x = X - 1; x >= 0; x--) {
+    status[x] = stat;
+    stat = path[x + stat * X];
+  }
+}
+
+void ReferenceCut(const HMMModel& model,
+      RuneStrArray::const_iterator begin,
+      RuneStrArray::const_iterator end,
+      vector<WordRange>& res) {
+  vector<size_t> status;
+  ReferenceViterbi(model, begin, end, status);
+  RuneStrArray::const_iterator left = begin;
+  for (size_t i = 0; i < status.size(); i++) {
+    if (status[i] % 2) {
+      res.push_back(WordRange(left, begin + i));
+      left = begin + i + 1;
+    }
+  }
+}
+
+// Runs both Viterbis over every run of non-ASCII runes of the file, which is
+// what HMMSegment sees inside MixSegment, and checks they cut the same.
+void Bench(const HMMModel& model, const string& path, size_t times) {
+  string doc;
+  ifstream ifs(path.c_str());
+  assert(ifs);
+  doc << ifs;
+  RuneStrArray runes;
+  if (!DecodeRunesInString(doc, runes)) {
+    XLOG(ERROR) << "decode " << path << " failed";
+    return;
+  }
+  vector<pair<size_t, size_t> > spans;
+  for (size_t i = 0, j = 0; i < runes.size(); i = j) {
+    bool ascii = runes[i].rune < 0x80;
+    while (j < runes.size() && (runes[j].rune < 0x80) == ascii) {
+      j++;
+    }
+    if (!ascii) {
+      spans.push_back(make_pair(i, j));
+    }
+  }
+
+  HMMSegment seg(&model);
+  SegmentContext ctx;
+  vector<WordRange> expected, actual;
+  long beginTime = clock();
+  for (size_t t = 0; t < times; t++) {
+    expected.clear();
+    for (size_t i = 0; i < spans.size(); i++) {
+      ReferenceCut(model, runes.begin() + spans[i].first, runes.begin() + spans[i].second, expected);
+    }
+  }
+  long midTime = clock();
+  for (size_t t = 0; t < times; t++) {
+    actual.clear();
+    for (size_t i = 0; i < spans.size(); i++) {
+      seg.Cut(runes.begin() + spans[i].first, runes.begin() + spans[i].second, actual, ctx);
+    }
+  }
+  long endTime = clock();
+
+  size_t diff = 0;
+  if (expected.size() != actual.size()) {
+    diff = max(expected.size(), actual.size());
+  } else {
+    for (size_t i = 0; i < expected.size(); i++) {
+      if (expected[i].left != actual[i].left || expected[i].right != actual[i].right) {
+        diff++;
+      }
+    }
+  }
+  printf("%s: %zu runes, %zu words, %zu different\n", path.c_str(), runes.size(), expected.size(), diff);
+  ColorPrintln(GREEN, "double Viterbi: [%.3lf seconds]time consumed.", double(midTime - beginTime)/CLOCKS_PER_SEC);
+  ColorPrintln(GREEN, "float Viterbi: [%.3lf seconds]time consumed.", double(endTime - midTime)/CLOCKS_PER_SEC);
+}
+
+// viterbi_bench [file...]: weicheng.utf8 by default
+int main(int argc, char ** argv) {
+  HMMModel model("../dict/hmm_model.utf8");
+  if (argc < 2) {
+    Bench(model, "../test/testdata/weicheng.utf8", 50);
+  }
+  for (int i = 1; i < argc; i++) {
+    Bench(model, argv[i], 1);
+  }
+  return EXIT_SUCCESS;
+}
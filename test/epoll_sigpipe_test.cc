@@ -0,0 +1,109 @@
+// epoll前端的回归测试：客户端在一个连接上流水线发一个交给工作线程的/s和一串走sendfile的静态文件请求，
+// 不读响应直接close。服务器之后往这个连接上写会收到RST，再写就是EPIPE，
+// 没有忽略SIGPIPE的话整个进程（也就是这个测试）会被信号杀掉，退出码141。
+// 用法：./epoll_sigpipe_test [port]，服务器还活着、还能正常回应就返回0
+#include <cstdio>
+#include <fstream>
+#include <arpa/inet.h>
+#include "../epoll_server.hpp"
+
+static int Connect(int port)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool SendAll(int fd, const std::string &data)
+{
+    for (size_t off = 0; off < data.size();)
+    {
+        ssize_t n = ::send(fd, data.data() + off, data.size() - off, MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+        off += n;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    int port = argc > 1 ? std::atoi(argv[1]) : 18089;
+    const std::string file = "/tmp/epoll_sigpipe_test.bin";
+    std::ofstream(file, std::ios::binary) << std::string(256 * 1024, 'x');
+
+    ns_epoll::Options opt;
+    opt.address = "127.0.0.1";
+    opt.port = port;
+    opt.loops = 1;
+    opt.threads = 2;
+    ns_epoll::EpollServer *svr = new ns_epoll::EpollServer(opt); // 事件循环不会退出，进程结束时不析构
+    svr->Get("/s", [](const ns_epoll::Request &, ns_epoll::Response &resp)
+             {
+                 std::this_thread::sleep_for(std::chrono::milliseconds(20)); // 等客户端先关掉
+                 resp.set_content(std::string(256 * 1024, 'y'), "text/plain"); }, true);
+    svr->SetFallback([&file](const ns_epoll::Request &, ns_epoll::Response &resp)
+                     {
+                         resp.file = file;
+                         resp.file_size = 256 * 1024; });
+    std::thread([svr]
+                { svr->Run(); })
+        .detach();
+
+    // 等服务器开始监听
+    int fd = -1;
+    for (int i = 0; i < 100 && fd < 0; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        fd = Connect(port);
+    }
+    if (fd < 0)
+    {
+        std::fprintf(stderr, "connect 127.0.0.1:%d failed\n", port);
+        return 1;
+    }
+    ::close(fd);
+
+    std::string pipelined = "GET /s?word=boost HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    for (int i = 0; i < 10; i++)
+        pipelined += "GET /index.html HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    for (int round = 0; round < 20; round++)
+    {
+        fd = Connect(port);
+        if (fd < 0 || !SendAll(fd, pipelined))
+        {
+            std::fprintf(stderr, "round %d: send failed\n", round);
+            return 1;
+        }
+        ::close(fd);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    // 服务器还在，新的连接照常处理
+    fd = Connect(port);
+    std::string reply;
+    if (fd >= 0 && SendAll(fd, "GET /s?word=boost HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n"))
+    {
+        char buf[64 * 1024];
+        ssize_t n;
+        while ((n = ::read(fd, buf, sizeof(buf))) > 0)
+            reply.append(buf, n);
+    }
+    if (reply.compare(0, 12, "HTTP/1.1 200") != 0)
+    {
+        std::fprintf(stderr, "server did not answer after clients closed early\n");
+        std::_Exit(1);
+    }
+    std::printf("epoll_sigpipe_test ok\n");
+    std::fflush(stdout);
+    std::_Exit(0);
+}
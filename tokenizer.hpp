@@ -0,0 +1,123 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace ns_tokenizer
+{
+    // 面向C++代码的分词：文档是boost的文档，ASCII部分大多是代码和英文，
+    // 一遍扫描切出标识符和数字，不经过jieba。
+    //   boost::asio::async_read_until -> boost, asio, async_read_until, async, read, until, boost::asio::async_read_until
+    //   BOOST_PROTO_EXTENDS           -> BOOST_PROTO_EXTENDS, BOOST, PROTO, EXTENDS
+    //   basic_streambuf<CharT>        -> basic_streambuf, basic, streambuf, CharT, Char, T
+    // 标识符原样输出，再按下划线和大小写切出的各部分（只有一部分时不重复输出），
+    // 用::连起来的限定名再整体输出一次。模板的<>、空白和其它标点只起分隔作用，不输出。
+    // 大小写保持原样，转小写由调用方统一做。
+    // 切出来的词都是原文里连续的一段，Token可以是std::string，也可以是只记录位置的视图，
+    // 只要能用(const char *, size_t)构造、有size()
+    class CodeTokenizer
+    {
+    public:
+        // 把ASCII文本[text, text + len)切出来的词追加到out后面
+        template <class Token>
+        static void Tokenize(const char *text, size_t len, std::vector<Token> *out)
+        {
+            const char *end = text + len;
+            const char *p = text;
+            while (p < end)
+            {
+                if (IsIdentStart(*p))
+                {
+                    p = ScanQualifiedName(p, end, out);
+                }
+                else if (IsDigit(*p))
+                {
+                    p = ScanNumber(p, end, out);
+                }
+                else
+                {
+                    ++p;
+                }
+            }
+        }
+
+    private:
+        static bool IsUpper(char c) { return c >= 'A' && c <= 'Z'; }
+        static bool IsLower(char c) { return c >= 'a' && c <= 'z'; }
+        static bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+        static bool IsIdentStart(char c) { return IsUpper(c) || IsLower(c) || c == '_'; }
+        static bool IsIdent(char c) { return IsIdentStart(c) || IsDigit(c); }
+
+        // a::b::c：每一段按标识符输出，段数大于1时再输出整个限定名
+        template <class Token>
+        static const char *ScanQualifiedName(const char *p, const char *end, std::vector<Token> *out)
+        {
+            const char *start = p;
+            size_t segments = 0;
+            for (;;)
+            {
+                const char *seg = p;
+                while (p < end && IsIdent(*p))
+                    ++p;
+                EmitIdentifier(seg, p, out);
+                ++segments;
+                // 只有"::"后面紧跟着标识符才算同一个限定名，"a::"和"a::~b"在::处断开
+                if (end - p >= 3 && p[0] == ':' && p[1] == ':' && IsIdentStart(p[2]))
+                    p += 2;
+                else
+                    break;
+            }
+            if (segments > 1)
+                out->emplace_back(start, p - start);
+            return p;
+        }
+
+        // 3.14、1.66.0、0x1f、10ms整体一个词，末尾的'.'是句号，不算在内
+        template <class Token>
+        static const char *ScanNumber(const char *p, const char *end, std::vector<Token> *out)
+        {
+            const char *start = p;
+            while (p < end && (IsIdent(*p) || *p == '.'))
+                ++p;
+            const char *last = p;
+            while (last[-1] == '.')
+                --last;
+            out->emplace_back(start, last - start);
+            return p;
+        }
+
+        // 输出标识符本身，再按下划线和大小写边界切开：
+        // snake_case -> snake, case；CamelCase -> Camel, Case；HTTPServer -> HTTP, Server；utf8String -> utf8, String
+        template <class Token>
+        static void EmitIdentifier(const char *begin, const char *end, std::vector<Token> *out)
+        {
+            out->emplace_back(begin, end - begin);
+            size_t first = out->size();
+            const char *part = begin;
+            for (const char *p = begin; p <= end; ++p)
+            {
+                bool cut = false, skip = false;
+                if (p == end || *p == '_')
+                {
+                    cut = skip = true;
+                }
+                else if (p > part && IsUpper(*p))
+                {
+                    // 小写或数字后面的大写；或者连续大写（至少两个）之后、接着小写的那个大写
+                    cut = !IsUpper(p[-1]) ||
+                          (p - part >= 2 && IsUpper(p[-2]) && p + 1 < end && IsLower(p[1]));
+                }
+                if (cut)
+                {
+                    if (p > part)
+                        out->emplace_back(part, p - part);
+                    part = skip ? p + 1 : p;
+                }
+            }
+            // 只切出一部分并且就是标识符本身时，去掉重复的那个
+            if (out->size() == first + 1 && out->back().size() == (size_t)(end - begin))
+                out->pop_back();
+        }
+    };
+}
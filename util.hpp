@@ -3,9 +3,17 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <cstring>
+#include <cstdlib>
 #include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
 #include <boost/algorithm/string.hpp>
 #include "cppjieba/Jieba.hpp"
+#include "log.hpp"
+#include "tokenizer.hpp"
+#include "batch.hpp"
 
 namespace ns_util
 {
@@ -17,7 +25,7 @@ namespace ns_util
             std::ifstream in(path);
             if (!in.is_open())
             {
-                std::cout << "open " << path << " file error" << std::endl;
+                LOG(ERROR) << "open " << path << " file error";
                 return false;
             }
             std::string line;
@@ -30,6 +38,37 @@ namespace ns_util
         }
     };
 
+    // 只读的字符串视图，不拥有内存（-std=c++11 下没有std::string_view）
+    class StringView
+    {
+    public:
+        StringView() : _data(""), _size(0) {}
+        StringView(const char *data, size_t size) : _data(data), _size(size) {}
+        StringView(const std::string &s) : _data(s.data()), _size(s.size()) {}
+        StringView(const char *s) : _data(s), _size(std::strlen(s)) {}
+
+        const char *data() const { return _data; }
+        size_t size() const { return _size; }
+        bool empty() const { return _size == 0; }
+        const char *begin() const { return _data; }
+        const char *end() const { return _data + _size; }
+        char operator[](size_t i) const { return _data[i]; }
+
+        StringView substr(size_t pos, size_t len = std::string::npos) const
+        {
+            if (pos > _size)
+                pos = _size;
+            if (len > _size - pos)
+                len = _size - pos;
+            return StringView(_data + pos, len);
+        }
+        std::string ToString() const { return std::string(_data, _size); }
+
+    private:
+        const char *_data;
+        size_t _size;
+    };
+
     class StringUtil
     {
     public:
@@ -39,6 +78,134 @@ namespace ns_util
             boost::split(*out, line, boost::is_any_of(sep), boost::algorithm::token_compress_on);
             return true;
         }
+
+        // 只转换ASCII字母，UTF-8的多字节序列保持不变（与C locale下的boost::to_lower一致）
+        static void ToLowerAscii(std::string *s)
+        {
+            ToLowerAscii(&(*s)[0], s->size());
+        }
+        static void ToLowerAscii(char *s, size_t len)
+        {
+            for (size_t i = 0; i < len; i++)
+            {
+                if (s[i] >= 'A' && s[i] <= 'Z')
+                    s[i] += 'a' - 'A';
+            }
+        }
+    };
+
+    // 停用词表：词条连续存放，开放寻址（线性探测）的哈希表里存下标+1，0表示空槽，
+    // 装载因子不超过1/2。加载后只读，多个线程可以同时查
+    class StopWords
+    {
+    public:
+        StopWords() : _mask(0), _hits(0) {}
+
+        bool Load(const std::string &path)
+        {
+            std::ifstream in(path);
+            if (!in.is_open())
+            {
+                return false;
+            }
+            std::vector<std::string> words;
+            std::string line;
+            while (std::getline(in, line))
+            {
+                words.push_back(line);
+            }
+            size_t size = 16;
+            while (size < words.size() * 2)
+                size *= 2;
+            _slots.assign(size, 0);
+            _mask = size - 1;
+            for (auto &w : words)
+            {
+                size_t pos = Hash(w.data(), w.size()) & _mask;
+                for (; _slots[pos] != 0; pos = (pos + 1) & _mask)
+                {
+                    if (Word(_slots[pos] - 1) == w)
+                        break;
+                }
+                if (_slots[pos] != 0)
+                    continue; // 重复的词
+                _offsets.push_back(_chars.size());
+                _chars += w;
+                _slots[pos] = _offsets.size(); // 下标+1
+            }
+            _offsets.push_back(_chars.size());
+            return true;
+        }
+
+        bool Contains(const char *data, size_t len) const
+        {
+            if (_slots.empty())
+                return false;
+            for (size_t pos = Hash(data, len) & _mask; _slots[pos] != 0; pos = (pos + 1) & _mask)
+            {
+                uint32_t i = _slots[pos] - 1;
+                if (_offsets[i + 1] - _offsets[i] == len && std::memcmp(_chars.data() + _offsets[i], data, len) == 0)
+                    return true;
+            }
+            return false;
+        }
+
+        // 一遍扫描去掉words里的停用词，保持其余词的顺序，返回去掉的个数。
+        // Token是std::string或者StringView
+        template <class Token>
+        size_t Filter(std::vector<Token> *words)
+        {
+            size_t n = 0;
+            for (size_t i = 0; i < words->size(); i++)
+            {
+                Token &w = (*words)[i];
+                if (Contains(w.data(), w.size()))
+                    continue;
+                if (n != i)
+                    (*words)[n] = std::move(w);
+                ++n;
+            }
+            size_t removed = words->size() - n;
+            words->resize(n);
+            _hits.fetch_add(removed, std::memory_order_relaxed);
+            return removed;
+        }
+
+        size_t Size() const { return _offsets.empty() ? 0 : _offsets.size() - 1; }
+        // 累计过滤掉的停用词个数
+        uint64_t Hits() const { return _hits.load(std::memory_order_relaxed); }
+
+    private:
+        std::string Word(uint32_t i) const { return _chars.substr(_offsets[i], _offsets[i + 1] - _offsets[i]); }
+
+        static uint32_t Hash(const char *data, size_t len)
+        {
+            uint32_t h = 2166136261u;
+            for (size_t i = 0; i < len; i++)
+            {
+                h ^= (unsigned char)data[i];
+                h *= 16777619u;
+            }
+            return h;
+        }
+
+        std::string _chars;             // 所有停用词首尾相连
+        std::vector<uint32_t> _offsets; // 第i个词是[_offsets[i], _offsets[i+1])
+        std::vector<uint32_t> _slots;
+        size_t _mask;
+        std::atomic<uint64_t> _hits;
+    };
+
+    // 一批文本的分词结果：所有词的视图首尾相连放在words里，第i段文本的词是
+    // words[offsets[i], offsets[i+1])。视图指向原文，原文要比结果活得久
+    struct CutBatch
+    {
+        std::vector<StringView> words;
+        std::vector<size_t> offsets;
+
+        size_t Size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+        const StringView *Begin(size_t i) const { return words.data() + offsets[i]; }
+        const StringView *End(size_t i) const { return words.data() + offsets[i + 1]; }
     };
 
     const char *const DICT_PATH = "./dict/jieba.dict.utf8";
@@ -46,67 +213,120 @@ namespace ns_util
     const char *const USER_DICT_PATH = "./dict/user.dict.utf8";
     const char *const IDF_PATH = "./dict/idf.utf8";
     const char *const STOP_WORD_PATH = "./dict/stop_words.utf8";
+    // dict_compiler把上面的词典、用户词典和HMM模型编译成的镜像，启动时直接mmap
+    const char *const DICT_IMAGE_PATH = "./dict/jieba.dict.img";
     class JiebaUtil
     {
+    public:
+        typedef std::shared_ptr<const cppjieba::Jieba> JiebaPtr;
+
     private:
         // static cppjieba::Jieba jieba;
-        cppjieba::Jieba jieba;
-        std::unordered_map<std::string, bool> stop_words;
-        JiebaUtil() : jieba(DICT_PATH, HMM_PATH, USER_DICT_PATH, IDF_PATH, STOP_WORD_PATH) {}
+        // 查询和建索引都通过atomic_load取当前的分词器，ReloadUserDict用atomic_store整个换掉，
+        // 正在用旧分词器切的线程拿着shared_ptr，切完旧的才释放
+        JiebaPtr jieba;
+        StopWords stop_words;
+        // CutStringsForSearch用的常驻线程和各线程的词数组，在多批之间复用
+        std::mutex batch_mtx;
+        std::unique_ptr<ns_batch::ParallelRunner> batch_runner;
+        std::vector<std::vector<StringView>> batch_arenas; // 1号以后的线程各一个
+        std::vector<StringView> batch_merged;
+        JiebaUtil() : jieba(LoadJieba())
+        {
+            // 启动时没有词典没法分词，和以前cppjieba打不开文件时一样直接退出
+            if (!jieba)
+            {
+                LOG(ERROR) << "加载词典失败";
+                std::exit(1);
+            }
+        }
         JiebaUtil(const JiebaUtil &) = delete;
         JiebaUtil &operator=(const JiebaUtil &) = delete;
         static JiebaUtil *instance;
+        static std::once_flag once;
 
     public:
+        // 建索引的工作线程和http的工作线程会同时第一次调用，用call_once保证只创建一次
         static JiebaUtil *get_instance()
         {
-            std::mutex mtx;
-            if (instance == nullptr)
-            {
-                mtx.lock();
-                if (instance == nullptr)
-                {
-                    instance = new JiebaUtil();
-                    instance->InitJiebaUtil();
-                }
-                mtx.unlock();
-            }
-
+            std::call_once(once, []
+                           {
+                               instance = new JiebaUtil();
+                               instance->InitJiebaUtil(); });
             return instance;
         }
 
         void InitJiebaUtil()
         {
-            std::ifstream in(STOP_WORD_PATH);
-            if (!in.is_open())
+            if (!stop_words.Load(STOP_WORD_PATH))
             {
-                std::cout << "打开文件失败" << std::endl;
+                LOG(ERROR) << "打开停用词文件失败";
                 return;
             }
-            std::string line;
-            while (std::getline(in, line))
-            {
-                stop_words.insert({line, true});
-            }
-            in.close();
+            LOG(DEBUG) << "加载停用词 " << stop_words.Size() << " 个";
         }
 
-        void CutStringForSearchHelper(const std::string &str, std::vector<std::string> *out)
+        // 按现在的词典文件新建一个分词器。
+        // 优先用编译好的词典镜像，镜像不存在或者词典文件改过了才解析文本词典。
+        // cppjieba打不开文件会直接退出进程，所以先检查一遍，打不开的返回空
+        static JiebaPtr LoadJieba()
         {
-            jieba.CutForSearch(str, *out);
-            for (auto iter = out->begin(); iter != out->end();)
+            std::shared_ptr<cppjieba::DictImage> image = cppjieba::Jieba::OpenImage(DICT_IMAGE_PATH, DICT_PATH, HMM_PATH, USER_DICT_PATH);
+            if (image)
+            {
+                return JiebaPtr(new cppjieba::Jieba(image, IDF_PATH, STOP_WORD_PATH));
+            }
+            const char *const paths[] = {DICT_PATH, HMM_PATH, USER_DICT_PATH, IDF_PATH, STOP_WORD_PATH};
+            for (const char *path : paths)
             {
-                auto it = stop_words.find(*iter); // 看有没有暂停词
-                if (it != stop_words.end())
+                if (!std::ifstream(path).is_open())
                 {
-                    // 去掉暂停词
-                    iter = out->erase(iter);
+                    LOG(ERROR) << "open " << path << " file error";
+                    return JiebaPtr();
                 }
-                else
+            }
+            LOG(WARNING) << DICT_IMAGE_PATH << " 不存在或已过期，解析文本词典（运行dict_compiler重新生成）";
+            return JiebaPtr(new cppjieba::Jieba(DICT_PATH, HMM_PATH, USER_DICT_PATH, IDF_PATH, STOP_WORD_PATH));
+        }
+
+        // 当前的分词器，用它切的过程中不会被释放
+        static JiebaPtr CurrentJieba()
+        {
+            return std::atomic_load(&get_instance()->jieba);
+        }
+
+        // 换上新的分词器，之后的分词都用它；正在进行的分词还用旧的切完
+        static void ReplaceJieba(const JiebaPtr &fresh)
+        {
+            std::atomic_store(&get_instance()->jieba, fresh);
+        }
+
+        // ASCII的部分（代码、英文）交给CodeTokenizer，其余的（中文）交给jieba。
+        // 两种文本的边界一定是UTF-8字符边界：多字节字符的每个字节都>=0x80。
+        // jieba是只读的，所有线程共用；分词用的临时空间每个线程一份，反复使用不再分配，换了分词器也照用。
+        // 切出来的词是指向str的视图，不拷贝
+        void CutStringForSearchHelper(const cppjieba::Jieba &jieba, const std::string &str, std::vector<StringView> *out)
+        {
+            static thread_local cppjieba::SegmentContext ctx;
+            static thread_local std::vector<cppjieba::WordSpan> spans;
+            static thread_local std::string piece;
+            out->clear();
+            for (size_t i = 0, j = 0; i < str.size(); i = j)
+            {
+                bool ascii = !(str[i] & 0x80);
+                while (j < str.size() && !(str[j] & 0x80) == ascii)
+                    ++j;
+                if (ascii)
                 {
-                    ++iter;
+                    ns_tokenizer::CodeTokenizer::Tokenize(str.data() + i, j - i, out);
+                    continue;
                 }
+                piece.assign(str, i, j - i);
+                jieba.CutForSearch(piece, spans, true, ctx);
+                for (auto &s : spans)
+                    out->emplace_back(str.data() + i + s.offset, s.len);
             }
+            stop_words.Filter(out); // 去掉停用词
         }
 
     public:
@@ -114,10 +334,84 @@ namespace ns_util
         static void CutStringForSearch(const std::string &str, std::vector<std::string> *out)
         {
             // jieba.CutForSearch(str, *out);
-            ns_util::JiebaUtil::get_instance()->CutStringForSearchHelper(str, out);
+            CutStringForSearch(*CurrentJieba(), str, out);
+        }
+
+        // 用指定的分词器切，比较换词典前后的分词结果时用
+        static void CutStringForSearch(const cppjieba::Jieba &jieba, const std::string &str, std::vector<std::string> *out)
+        {
+            static thread_local std::vector<StringView> views;
+            get_instance()->CutStringForSearchHelper(jieba, str, &views);
+            out->resize(views.size());
+            for (size_t i = 0; i < views.size(); i++)
+                (*out)[i].assign(views[i].data(), views[i].size());
+        }
+
+        // 切出来的词是指向str的视图，str要比out活得久。建索引时用，省掉每个词一次拷贝
+        static void CutStringForSearch(const std::string &str, std::vector<StringView> *out)
+        {
+            get_instance()->CutStringForSearchHelper(*CurrentJieba(), str, out);
+        }
+
+        // 一次切一批文本，在常驻的一组线程上按工作窃取分着做（线程数取CPU核数，第一次调用时创建）。
+        // 工作线程在多次调用之间一直活着，它们thread_local的分词上下文也就一直复用。
+        // 每个线程把词追加到自己的数组里（0号线程是调用线程，直接用out->words），全部做完再按文本顺序拼起来；
+        // 只有一个线程时词本来就是按顺序追加的，不用再拼。同时只有一个调用在跑
+        static void CutStringsForSearch(const std::vector<const std::string *> &texts, CutBatch *out)
+        {
+            struct Piece
+            {
+                size_t worker; // 切在哪个线程的数组里
+                size_t begin;
+                size_t size;
+            };
+            JiebaUtil *self = get_instance();
+            std::lock_guard<std::mutex> lock(self->batch_mtx);
+            if (!self->batch_runner)
+            {
+                self->batch_runner.reset(new ns_batch::ParallelRunner(0));
+                self->batch_arenas.resize(self->batch_runner->Threads() - 1);
+            }
+            JiebaPtr jieba = CurrentJieba(); // 一批都用同一个分词器
+            std::vector<std::vector<StringView>> &local = self->batch_arenas;
+            for (auto &arena : local)
+                arena.clear();
+            std::vector<Piece> pieces(texts.size());
+            out->words.clear();
+            self->batch_runner->For(texts.size(), [&](size_t worker, size_t i)
+                                    {
+                                        static thread_local std::vector<StringView> views;
+                                        self->CutStringForSearchHelper(*jieba, *texts[i], &views);
+                                        std::vector<StringView> &arena = worker == 0 ? out->words : local[worker - 1];
+                                        pieces[i].worker = worker;
+                                        pieces[i].begin = arena.size();
+                                        pieces[i].size = views.size();
+                                        arena.insert(arena.end(), views.begin(), views.end()); });
+
+            out->offsets.resize(texts.size() + 1);
+            out->offsets[0] = 0;
+            for (size_t i = 0; i < texts.size(); i++)
+                out->offsets[i + 1] = out->offsets[i] + pieces[i].size;
+            if (local.empty())
+                return;
+            std::vector<StringView> &words = self->batch_merged;
+            words.resize(out->offsets.back());
+            for (size_t i = 0; i < texts.size(); i++)
+            {
+                const StringView *from = (pieces[i].worker == 0 ? out->words : local[pieces[i].worker - 1]).data() + pieces[i].begin;
+                std::copy(from, from + pieces[i].size, words.begin() + out->offsets[i]);
+            }
+            out->words.swap(words); // 换下来的旧数组留着下一批用
+        }
+
+        // 到目前为止分词结果里去掉的停用词个数
+        static uint64_t StopWordHits()
+        {
+            return ns_util::JiebaUtil::get_instance()->stop_words.Hits();
         }
     };
 
     // cppjieba::Jieba JiebaUtil::jieba(DICT_PATH, HMM_PATH, USER_DICT_PATH, IDF_PATH, STOP_WORD_PATH);
     JiebaUtil *JiebaUtil::instance = nullptr;
+    std::once_flag JiebaUtil::once;
 }
\ No newline at end of file